@@ -22,9 +22,11 @@ class connection
     private boost::noncopyable
 {
 public:
-  /// Construct a connection with the given io_service.
+  /// Construct a connection with the given io_service.  An idle connection
+  /// is closed after keep_alive_timeout seconds without a request.
   explicit connection(boost::asio::io_service& io_service,
-      request_handler_base<RequestHandler>& handler);
+      request_handler_base<RequestHandler>& handler,
+      std::size_t keep_alive_timeout = 15);
 
   /// Get the socket associated with the connection.
   boost::asio::ip::tcp::socket& socket();
@@ -33,6 +35,15 @@ public:
   void start();
 
 private:
+  /// Start reading the next request, closing the connection if it stays idle.
+  void read();
+
+  /// Parse whatever is buffered, and reply or read more.
+  void process();
+
+  /// Send reply_ once the handler has filled it in.
+  void write();
+
   /// Handle completion of a read operation.
   void handle_read(const boost::system::error_code& e,
       std::size_t bytes_transferred);
@@ -40,6 +51,9 @@ private:
   /// Handle completion of a write operation.
   void handle_write(const boost::system::error_code& e);
 
+  /// Handle expiry of the idle timer.
+  void handle_timeout(const boost::system::error_code& e);
+
   /// Strand to ensure the connection's handlers are not called concurrently.
   boost::asio::io_service::strand strand_;
 
@@ -52,6 +66,20 @@ private:
   /// Buffer for incoming data.
   boost::array<char, 8192> buffer_;
 
+  /// The part of buffer_ not yet consumed by the parser.  A client may
+  /// pipeline several requests into one read.
+  char * buffer_begin_;
+  char * buffer_end_;
+
+  /// Closes the connection when the client goes quiet.
+  boost::asio::deadline_timer timer_;
+
+  /// Seconds a connection may sit idle between requests.
+  std::size_t keep_alive_timeout_;
+
+  /// Whether to keep the connection open after the current reply.
+  bool keep_alive_;
+
   /// The incoming request.
   request request_;
 
@@ -64,16 +92,32 @@ private:
 
 template<class RequestHandler>
 connection<RequestHandler>::connection(boost::asio::io_service& io_service,
-    request_handler_base<RequestHandler>& handler)
+    request_handler_base<RequestHandler>& handler,
+    std::size_t keep_alive_timeout)
 : strand_(io_service),
   socket_(io_service),
-  request_handler_(handler)
+  request_handler_(handler),
+  timer_(io_service),
+  keep_alive_timeout_(keep_alive_timeout),
+  keep_alive_(false)
 {
+  buffer_begin_ = buffer_end_ = buffer_.data();
 }
 
 template<class RequestHandler>
 void connection<RequestHandler>::start()
 {
+  read();
+}
+
+template<class RequestHandler>
+void connection<RequestHandler>::read()
+{
+  timer_.expires_from_now(boost::posix_time::seconds(keep_alive_timeout_));
+  timer_.async_wait(
+      strand_.wrap(
+        boost::bind(&connection<RequestHandler>::handle_timeout, connection<RequestHandler>::shared_from_this(),
+          boost::asio::placeholders::error)));
   socket_.async_read_some(boost::asio::buffer(buffer_),
       strand_.wrap(
         boost::bind(&connection<RequestHandler>::handle_read, connection<RequestHandler>::shared_from_this(),
@@ -81,40 +125,64 @@ void connection<RequestHandler>::start()
           boost::asio::placeholders::bytes_transferred)));
 }
 
+template<class RequestHandler>
+void connection<RequestHandler>::process()
+{
+  boost::tribool result;
+  boost::tie(result, buffer_begin_) = request_parser_.parse(
+      request_, buffer_begin_, buffer_end_);
+
+  if (result)
+  {
+    // the handler may answer right away or later from another thread: either
+    // way the write happens back on our strand
+    keep_alive_ = request_.keep_alive();
+    request_handler_.dispatch_request(request_, reply_,
+        strand_.wrap(
+          boost::bind(&connection<RequestHandler>::write, connection<RequestHandler>::shared_from_this())));
+  }
+  else if (!result)
+  {
+    keep_alive_ = false;
+    reply_ = reply::stock_reply(reply::bad_request);
+    write();
+  }
+  else
+    read();
+}
+
+template<class RequestHandler>
+void connection<RequestHandler>::write()
+{
+  if (!keep_alive_)
+  {
+    reply_.headers.push_back(header());
+    reply_.headers.back().name = "Connection";
+    reply_.headers.back().value = "close";
+  }
+  else if (request_.http_version_major == 1 && request_.http_version_minor == 0)
+  {
+    reply_.headers.push_back(header());
+    reply_.headers.back().name = "Connection";
+    reply_.headers.back().value = "keep-alive";
+  }
+  boost::asio::async_write(socket_, reply_.to_buffers(),
+      strand_.wrap(
+        boost::bind(&connection<RequestHandler>::handle_write, connection<RequestHandler>::shared_from_this(),
+          boost::asio::placeholders::error)));
+}
+
 template<class RequestHandler>
 void connection<RequestHandler>::handle_read(const boost::system::error_code& e,
     std::size_t bytes_transferred)
 {
+  timer_.cancel();
+
   if (!e)
   {
-    boost::tribool result;
-    boost::tie(result, boost::tuples::ignore) = request_parser_.parse(
-        request_, buffer_.data(), buffer_.data() + bytes_transferred);
-
-    if (result)
-    {
-      request_handler_.handle_request_base(request_, reply_);
-      boost::asio::async_write(socket_, reply_.to_buffers(),
-          strand_.wrap(
-            boost::bind(&connection<RequestHandler>::handle_write, connection<RequestHandler>::shared_from_this(),
-              boost::asio::placeholders::error)));
-    }
-    else if (!result)
-    {
-      reply_ = reply::stock_reply(reply::bad_request);
-      boost::asio::async_write(socket_, reply_.to_buffers(),
-          strand_.wrap(
-            boost::bind(&connection<RequestHandler>::handle_write, connection<RequestHandler>::shared_from_this(),
-              boost::asio::placeholders::error)));
-    }
-    else
-    {
-      socket_.async_read_some(boost::asio::buffer(buffer_),
-          strand_.wrap(
-            boost::bind(&connection<RequestHandler>::handle_read, connection<RequestHandler>::shared_from_this(),
-              boost::asio::placeholders::error,
-              boost::asio::placeholders::bytes_transferred)));
-    }
+    buffer_begin_ = buffer_.data();
+    buffer_end_ = buffer_.data() + bytes_transferred;
+    process();
   }
 
   // If an error occurs then no new asynchronous operations are started. This
@@ -132,19 +200,47 @@ boost::asio::ip::tcp::socket& connection<RequestHandler>::socket()
 template<class RequestHandler>
 void connection<RequestHandler>::handle_write(const boost::system::error_code& e)
 {
-  if (!e)
+  if (e)
+    return;
+
+  if (keep_alive_)
+  {
+    // ready for the next request.  if the client already pipelined it, it's
+    // sitting in the buffer: answer it before reading any more
+    request_ = request();
+    reply_ = reply();
+    request_parser_.reset();
+    if (buffer_begin_ != buffer_end_)
+      process();
+    else
+      read();
+  }
+  else
   {
     // Initiate graceful connection closure.
     boost::system::error_code ignored_ec;
     socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored_ec);
   }
 
-  // No new asynchronous operations are started. This means that all shared_ptr
+  // If no new asynchronous operations are started, all shared_ptr
   // references to the connection object will disappear and the object will be
   // destroyed automatically after this handler returns. The connection class's
   // destructor closes the socket.
 }
 
+template<class RequestHandler>
+void connection<RequestHandler>::handle_timeout(const boost::system::error_code& e)
+{
+  // the timer may have fired just as a read completed: only close if it's
+  // still due, and not rearmed for the next request
+  if (e != boost::asio::error::operation_aborted
+      && timer_.expires_at() <= boost::asio::deadline_timer::traits_type::now())
+  {
+    boost::system::error_code ignored_ec;
+    socket_.close(ignored_ec);
+  }
+}
+
 }} // moost::http
 
 #endif // __MOOST_HTTP_CONNECTION_HPP__
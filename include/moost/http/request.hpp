@@ -30,6 +30,32 @@ struct request
     }
     return result;
   }
+
+  std::vector<header>::const_iterator find_header(const std::string & header_name) const
+  {
+    std::vector<header>::const_iterator result;
+    for (result = headers.begin(); result != headers.end(); ++result)
+    {
+      if (boost::algorithm::iequals(result->name, header_name))
+        break;
+    }
+    return result;
+  }
+
+  /// whether the client wants the connection kept open after this request:
+  /// the default for HTTP/1.1, opt-in with Connection: keep-alive for HTTP/1.0
+  bool keep_alive() const
+  {
+    std::vector<header>::const_iterator it = find_header("Connection");
+    if (it != headers.end())
+    {
+      if (boost::algorithm::iequals(it->value, "close"))
+        return false;
+      if (boost::algorithm::iequals(it->value, "keep-alive"))
+        return true;
+    }
+    return http_version_major > 1 || (http_version_major == 1 && http_version_minor >= 1);
+  }
 };
 
 }} // moost::http
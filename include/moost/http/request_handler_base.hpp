@@ -29,6 +29,24 @@ struct request_handler_base
     rep.headers[0].value = boost::lexical_cast<std::string>(rep.content.size());
   }
 
+  /// handle a request, calling done() once rep is ready.  req and rep stay
+  /// valid until then
+  template<class Completion>
+  void dispatch_request(const request& req, reply& rep, Completion done)
+  {
+    static_cast< RequestHandler * >(this)->handle_request_async(req, rep, done);
+  }
+
+  /// by default, handle the request right away on the calling i/o thread.
+  /// a handler with slow requests can instead queue them for its own
+  /// threads, and call done() from there
+  template<class Completion>
+  void handle_request_async(const request& req, reply& rep, Completion done)
+  {
+    handle_request_base(req, rep);
+    done();
+  }
+
   void handle_request(const request& req, reply& rep)
   {
     // default base implementation does nothing
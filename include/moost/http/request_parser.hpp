@@ -21,7 +21,8 @@ public:
   /// Parse some data. The tribool return value is true when a complete request
   /// has been parsed, false if the data is invalid, indeterminate when more
   /// data is required. The InputIterator return value indicates how much of the
-  /// input has been consumed.
+  /// input has been consumed: anything past it belongs to the next (pipelined)
+  /// request, which should be parsed after a call to reset().
   template <typename InputIterator>
   boost::tuple<boost::tribool, InputIterator> parse(request& req,
       InputIterator begin, InputIterator end)
@@ -44,7 +45,7 @@ public:
   }
 
   template<typename InputIterator>
-  boost::tribool consume_body(request & req, InputIterator begin, InputIterator end)
+  boost::tribool consume_body(request & req, InputIterator & begin, InputIterator end)
   {
     if (content_to_read_ < 0)
       return false; // probably bad content-length
@@ -22,9 +22,10 @@ class server
 {
 public:
   /// Construct the server to listen on the specified TCP address and port, and
-  /// serve up files from the given directory.
+  /// serve up files from the given directory.  Connections are kept alive
+  /// between requests, and closed after keep_alive_timeout idle seconds.
   explicit server(const std::string& address, int port,
-      std::size_t thread_pool_size);
+      std::size_t thread_pool_size, std::size_t keep_alive_timeout = 15);
 
   RequestHandler & request_handler()
   {
@@ -44,6 +45,9 @@ private:
   /// The number of threads that will call io_service::run().
   std::size_t thread_pool_size_;
 
+  /// Seconds an idle connection is kept open.
+  std::size_t keep_alive_timeout_;
+
   /// The io_service used to perform asynchronous operations.
   boost::asio::io_service io_service_;
 
@@ -62,11 +66,12 @@ private:
 
 template<class RequestHandler>
 server<RequestHandler>::server(const std::string& address, int port,
-    std::size_t thread_pool_size)
+    std::size_t thread_pool_size, std::size_t keep_alive_timeout)
   : thread_pool_size_(thread_pool_size),
+    keep_alive_timeout_(keep_alive_timeout),
     acceptor_(io_service_),
     request_handler_(),
-    new_connection_(new connection<RequestHandler>(io_service_, request_handler_))
+    new_connection_(new connection<RequestHandler>(io_service_, request_handler_, keep_alive_timeout))
 {
   boost::asio::ip::tcp::resolver resolver(io_service_);
   boost::asio::ip::tcp::resolver::query query(address, boost::lexical_cast<std::string>(port));
@@ -79,7 +84,7 @@ void server<RequestHandler>::handle_accept(const boost::system::error_code& e)
   if (!e)
   {
     new_connection_->start();
-    new_connection_.reset(new connection<RequestHandler>(io_service_, request_handler_));
+    new_connection_.reset(new connection<RequestHandler>(io_service_, request_handler_, keep_alive_timeout_));
   }
   acceptor_.async_accept(new_connection_->socket(),
     boost::bind(&server<RequestHandler>::handle_accept, this, boost::asio::placeholders::error));
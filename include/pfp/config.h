@@ -1,21 +1,32 @@
 #ifndef __CONFIG_H__
 #define __CONFIG_H__
 
+#include <cstddef>
+
 namespace com { namespace wavii { namespace pfp {
 
 // typedefs and consts
 
 typedef unsigned short state_t; // currently around 12,000 distinct states
+typedef unsigned short category_t; // basic categories of states: a few hundred
 typedef unsigned short word_t;  // around 47,000 words in our lexicon
 typedef float count_t;          // counts in our lexicon (just keep float for easy manipulation)
+#ifdef PFP_LONG_SENTENCES
+// for long sentences: positions past 255, and scores that don't run out of range on long spans.
+// charts take twice the memory, so use a sparse_workspace for the long ones
+typedef int score_t;
+typedef unsigned short pos_t;
+#else
 typedef short score_t;          // we don't need full float resolution, use short for memory+speed gain
-typedef unsigned char pos_t;    // word position in a sentence, never more than 100
+typedef unsigned char pos_t;    // word position in a sentence, never more than 254.  scores overflow well before that
+#endif
 
 struct consts
 {
   static const char * version;           // version of pfp engine
   static const float score_resolution;   // spread scores more evenly across a downcast space
   static const score_t empty_score;      // hasn't been scored
+  static const size_t max_sentence_size; // the longest sentence a workspace can hold, boundary included
   static const count_t smooth_threshold; // significance threshold for words we haven't seen enough to build our lexicon
   static const float word_smooth_factor; // add this much smoothing to word weights
   static const float sig_smooth_factor;  // add this much smoothing to signature weights
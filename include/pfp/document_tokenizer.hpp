@@ -0,0 +1,165 @@
+#ifndef __DOCUMENT_TOKENIZER_HPP__
+#define __DOCUMENT_TOKENIZER_HPP__
+
+#include <vector>
+#include <string>
+#include <istream>
+#include <algorithm>
+#include <boost/noncopyable.hpp>
+
+#include <pfp/tokenizer.h>
+
+namespace com { namespace wavii { namespace pfp {
+
+// splits running text into sentences of tokens, a sentence at a time.
+// input is read in blocks cut at line breaks and lexed with one reused
+// scanner, so documents of any size stream through in bounded memory.
+// a sentence ends after a run of . ? ! (plus any closing quotes or brackets
+// that follow), or at a blank line
+class document_tokenizer : private boost::noncopyable
+{
+private:
+
+  const tokenizer &              m_t;
+  tokenizer::scanner             m_scanner;
+  std::istream *                 m_in;           // read from a stream...
+  const char *                   m_mem;          // ...or from memory
+  const char *                   m_mem_end;
+  size_t                         m_block_size;
+  std::string                    m_block;        // the text we're currently handing out sentences from
+  std::string                    m_carry;        // text read past the last line break, for the next block
+  size_t                         m_offset;       // stream offset of m_block
+  std::string                    m_arena;
+  std::vector<tokenizer::span>   m_spans;        // tokens of m_block
+  size_t                         m_next;         // next token of m_spans to hand out
+  size_t                         m_gap;          // where in m_block the text since the last token begins
+  size_t                         m_newlines;     // newlines since the last token
+  bool                           m_final;        // the last token handed out can end a sentence
+  size_t                         m_begin;        // stream offsets of the last sentence
+  size_t                         m_end;
+
+  static bool is_final(const std::string & token)
+  {
+    return token == "." || token == "?" || token == "!";
+  }
+
+  // tokens that stay with the sentence they follow
+  static bool is_closer(const std::string & token)
+  {
+    return token == "''" || token == "'" || token == "-RRB-" || token == "-RCB-";
+  }
+
+  void count_newlines(size_t end)
+  {
+    m_newlines += std::count(m_block.begin() + m_gap, m_block.begin() + end, '\n');
+    m_gap = end;
+  }
+
+  // read the next block, returning false if there's nothing left
+  bool fill()
+  {
+    std::string buf;
+    buf.swap(m_carry);
+    size_t cut;
+    for (;;)
+    {
+      size_t have = buf.size();
+      buf.resize(have + m_block_size);
+      size_t got;
+      if (m_in)
+      {
+        m_in->read(&buf[have], m_block_size);
+        got = m_in->gcount();
+      }
+      else
+      {
+        got = std::min(m_block_size, static_cast<size_t>(m_mem_end - m_mem));
+        std::copy(m_mem, m_mem + got, &buf[have]);
+        m_mem += got;
+      }
+      buf.resize(have + got);
+      if (buf.empty())
+        return false;
+      // cut after the last line break, or failing that the last space, so we never split a token.
+      // at end of input, take everything
+      bool more = m_in ? static_cast<bool>(*m_in) : m_mem != m_mem_end;
+      if (!more)
+      {
+        cut = buf.size();
+        break;
+      }
+      cut = buf.find_last_of('\n');
+      if (cut == std::string::npos)
+        cut = buf.find_last_of(" \t");
+      if (cut != std::string::npos)
+      {
+        ++cut;
+        break;
+      }
+      // nowhere to cut: the block's one unfinished token, so read on until it ends
+    }
+    m_offset += m_block.size();
+    m_carry.assign(buf, cut, std::string::npos);
+    buf.resize(cut);
+    m_block.swap(buf);
+    m_arena.clear();
+    m_spans.clear();
+    m_scanner.tokenize(m_t, m_block.data(), m_block.size(), m_spans, m_arena);
+    m_next = 0;
+    m_gap = 0;
+    return true;
+  }
+
+public:
+
+  document_tokenizer(const tokenizer & t, std::istream & in, size_t block_size = 1 << 16)
+  : m_t(t), m_in(&in), m_mem(0), m_mem_end(0), m_block_size(block_size), m_offset(0),
+    m_next(0), m_gap(0), m_newlines(0), m_final(false), m_begin(0), m_end(0)
+  {
+  }
+
+  // read from memory, such as a mapped file.  [begin, end) must outlive us
+  document_tokenizer(const tokenizer & t, const char * begin, const char * end, size_t block_size = 1 << 16)
+  : m_t(t), m_in(0), m_mem(begin), m_mem_end(end), m_block_size(block_size), m_offset(0),
+    m_next(0), m_gap(0), m_newlines(0), m_final(false), m_begin(0), m_end(0)
+  {
+  }
+
+  // fill sentence with the tokens of the next sentence.  returns false when the input is exhausted
+  bool next(std::vector<std::string> & sentence)
+  {
+    sentence.clear();
+    for (;;)
+    {
+      for (; m_next != m_spans.size(); ++m_next)
+      {
+        const tokenizer::span & s = m_spans[m_next];
+        std::string token = s.str(m_block, m_arena);
+        count_newlines(s.begin);
+        if (!sentence.empty() && (m_newlines >= 2 || (m_final && !is_final(token) && !is_closer(token))))
+          return true;
+        if (sentence.empty())
+        {
+          m_begin = m_offset + s.begin;
+          m_final = false;
+        }
+        m_final = is_final(token) || (m_final && is_closer(token));
+        m_newlines = 0;
+        m_gap = s.begin + s.size;
+        m_end = m_offset + m_gap;
+        sentence.push_back(token);
+      }
+      count_newlines(m_block.size());
+      if (!fill())
+        return !sentence.empty();
+    }
+  }
+
+  // stream offsets of the sentence last returned by next, [begin, end)
+  size_t begin_offset() const { return m_begin; }
+  size_t end_offset() const { return m_end; }
+};
+
+}}} // com::wavii::pfp
+
+#endif // __DOCUMENT_TOKENIZER_HPP__
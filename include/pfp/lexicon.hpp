@@ -27,9 +27,22 @@ class lexicon
 {
 private:
 
+  typedef std::pair< state_t, count_t >                                             state_count_t;
+  typedef std::vector< state_count_t >::const_iterator                              state_count_iterator;
+
   const state_list &                                                                m_states;
-  std::vector< std::vector< std::pair< state_t, count_t > > >                       m_word_state;
-  std::vector< std::vector< std::pair< state_t, count_t > > >                       m_sig_state;
+  // state counts are stored flattened: the counts for word w live in
+  // m_word_state[m_word_offset[w] .. m_word_offset[w + 1]), and likewise for sigs
+  std::vector< size_t >                                                             m_word_offset;
+  std::vector< state_count_t >                                                      m_word_state;
+  std::vector< size_t >                                                             m_sig_offset;
+  std::vector< state_count_t >                                                      m_sig_state;
+  // chart-ready scores, precomputed at load for every sig (plus one trailing row for
+  // unseen sigs) and for every word we've seen often enough to not need smoothing
+  std::vector< size_t >                                                             m_word_score_offset;
+  std::vector< state_score_t >                                                      m_word_score;
+  std::vector< size_t >                                                             m_sig_score_offset;
+  std::vector< state_score_t >                                                      m_sig_score;
   boost::unordered_map< std::string, word_t >                                       m_word_index;
   boost::unordered_map< std::string, word_t >                                       m_sig_index;
   std::vector< count_t >                                                            m_word;
@@ -38,9 +51,9 @@ private:
   std::vector< count_t >                                                            m_unknown_state;
   count_t                                                                           m_known;
   count_t                                                                           m_unknown;
-  std::vector< std::pair< state_t, count_t > >                                      m_open_class;
-  std::vector< std::pair< state_t, count_t > >                                      m_any;
-  std::vector< std::pair< state_t, count_t > >                                      m_none;
+  std::vector< state_count_t >                                                      m_open_class;
+  std::vector< state_count_t >                                                      m_any;
+  std::vector< state_count_t >                                                      m_none;
 
   struct cmp_state_t_count_t
   {
@@ -49,12 +62,10 @@ private:
   };
 
   // outer join of major + minor, with preference for major at intersecting states
-  void merge_states(const std::vector< std::pair< state_t, count_t > > & major,
-                    const std::vector< std::pair< state_t, count_t > > & minor,
-                    std::vector< std::pair< state_t, count_t > > & out)
+  void merge_states(state_count_iterator it_maj, state_count_iterator end_maj,
+                    state_count_iterator it_min, state_count_iterator end_min,
+                    std::vector< state_count_t > & out)
   {
-    std::vector< std::pair< state_t, count_t > >::const_iterator it_maj = major.begin(), end_maj = major.end(),
-                                                                 it_min = minor.begin(), end_min = minor.end();
     while (it_maj != end_maj && it_min != end_min)
     {
       if (it_maj->first < it_min->first)
@@ -71,12 +82,10 @@ private:
   }
 
   // right join major + minor, with preference for major at intersecting states
-  void right_intersect_states(const std::vector< std::pair< state_t, count_t > > & major,
-                        const std::vector< std::pair< state_t, count_t > > & minor,
-                        std::vector< std::pair< state_t, count_t > > & out)
+  void right_intersect_states(state_count_iterator it_maj, state_count_iterator end_maj,
+                              state_count_iterator it_min, state_count_iterator end_min,
+                              std::vector< state_count_t > & out)
   {
-    std::vector< std::pair< state_t, count_t > >::const_iterator it_maj = major.begin(), end_maj = major.end(),
-                                                                 it_min = minor.begin(), end_min = minor.end();
     while (it_maj != end_maj && it_min != end_min)
     {
       if (it_maj->first < it_min->first)
@@ -90,6 +99,53 @@ private:
       out.push_back(*it_min++);
   }
 
+  // read [ key state count ] triples and flatten them into offset/value arrays,
+  // accumulating the per-key and per-state totals as we go
+  void load_state_counts(std::istream & in,
+                         word_t max_key,
+                         std::vector< size_t > & offsets,
+                         std::vector< state_count_t > & state_counts,
+                         std::vector< count_t > & key_totals,
+                         std::vector< count_t > & state_totals,
+                         count_t & total)
+  {
+    std::vector< std::pair< word_t, state_count_t > > triples;
+    std::pair< word_t, state_count_t > triple;
+    key_totals.clear(); key_totals.resize(max_key + 1);
+    state_totals.clear(); state_totals.resize(m_states.size());
+    offsets.clear(); offsets.resize(max_key + 2);
+    while (in >> triple.first >> triple.second.first >> triple.second.second)
+    {
+      key_totals[triple.first] += triple.second.second;
+      state_totals[triple.second.first] += triple.second.second;
+      total += triple.second.second;
+      ++offsets[triple.first + 1];
+      triples.push_back(triple);
+    }
+    for (word_t i = 0; i != max_key + 1; ++i)
+      offsets[i + 1] += offsets[i];
+    // scatter into place, keeping file order within a key, then sort each key's run by state
+    std::vector< size_t > next(offsets.begin(), offsets.end() - 1);
+    state_counts.clear(); state_counts.resize(triples.size());
+    for (std::vector< std::pair< word_t, state_count_t > >::const_iterator it = triples.begin(); it != triples.end(); ++it)
+      state_counts[next[it->first]++] = it->second;
+    for (word_t i = 0; i != max_key + 1; ++i)
+      std::sort(state_counts.begin() + offsets[i], state_counts.begin() + offsets[i + 1], cmp_state_t_count_t());
+  }
+
+  // downcast float weights to the score_t the chart works in
+  template <class OutputIterator>
+  static void to_chart(const std::vector< std::pair< state_t, float > > & weights, OutputIterator out)
+  {
+    for (std::vector< std::pair< state_t, float > >::const_iterator it = weights.begin(); it != weights.end(); ++it)
+      *out++ = state_score_t(it->first, it->second * consts::score_resolution);
+  }
+
+  bool smooth(word_t word) const
+  {
+    return m_word[word] <= consts::smooth_threshold;
+  }
+
   // get a very coarse signature of a word, consisting of whether
   // - the word is all caps
   // - the word is capitalized as the first word of a sentence
@@ -152,10 +208,12 @@ private:
   template <class OutputIterator>
   void word_score(word_t word, OutputIterator out, bool smooth)
   {
-    std::vector< std::pair< state_t, count_t > > states;
-    merge_states(m_word_state[word], smooth ? m_any : m_none, states);
+    std::vector< state_count_t > states;
+    const std::vector< state_count_t > & extra = smooth ? m_any : m_none;
+    merge_states(m_word_state.begin() + m_word_offset[word], m_word_state.begin() + m_word_offset[word + 1],
+                 extra.begin(), extra.end(), states);
 
-    for (std::vector< std::pair< state_t, count_t > >::const_iterator it = states.begin(); it != states.end(); ++it)
+    for (std::vector< state_count_t >::const_iterator it = states.begin(); it != states.end(); ++it)
     {
       float cw = m_word[word];
       float ct = m_known_state[it->first];
@@ -166,19 +224,20 @@ private:
     }
   }
 
-  // get the conditional probability for a word by building a signature out of it
+  // get the conditional probability for a signature, or for an unseen signature if sig is past the end
   template <class OutputIterator>
-  void sig_score(const std::string & word, OutputIterator out, int pos)
+  void sig_score(word_t sig, OutputIterator out)
   {
-    std::vector< std::pair< state_t, count_t > > states;
-    boost::unordered_map< std::string, word_t >::iterator it_s = m_sig_index.find(get_sig(word, pos));
-    if (it_s != m_sig_index.end())
-      right_intersect_states(m_sig_state[it_s->second], m_open_class, states);
+    std::vector< state_count_t > states;
+    bool found = sig < m_sig.size();
+    if (found)
+      right_intersect_states(m_sig_state.begin() + m_sig_offset[sig], m_sig_state.begin() + m_sig_offset[sig + 1],
+                             m_open_class.begin(), m_open_class.end(), states);
     else
       states = m_open_class;
-    for (std::vector< std::pair< state_t, count_t > >::const_iterator it = states.begin(); it != states.end(); ++it)
+    for (std::vector< state_count_t >::const_iterator it = states.begin(); it != states.end(); ++it)
     {
-      float cs = it_s == m_sig_index.end() ? 0.0 : m_sig[it_s->second];
+      float cs = found ? m_sig[sig] : 0.0;
       float ct = m_known_state[it->first];
       float pbts = (it->second + consts::sig_smooth_factor * (m_unknown_state[it->first] / m_unknown) ) / (cs + consts::sig_smooth_factor);
       float pbwt = std::log(pbts / ct);
@@ -187,6 +246,40 @@ private:
     }
   }
 
+  // look up the signature index for a word, or one past the last sig if we've never seen it
+  word_t sig_index(const std::string & word, int pos)
+  {
+    boost::unordered_map< std::string, word_t >::iterator it_s = m_sig_index.find(get_sig(word, pos));
+    return it_s != m_sig_index.end() ? it_s->second : static_cast<word_t>(m_sig.size());
+  }
+
+  // precompute the chart-ready scores for every sig and every unsmoothed word
+  void precompute_scores()
+  {
+    std::vector< std::pair< state_t, float > > weights;
+    m_sig_score.clear();
+    m_sig_score_offset.clear(); m_sig_score_offset.reserve(m_sig.size() + 2);
+    m_sig_score_offset.push_back(0);
+    for (word_t i = 0; i != m_sig.size() + 1; ++i)
+    {
+      weights.clear(); sig_score(i, std::back_inserter(weights));
+      to_chart(weights, std::back_inserter(m_sig_score));
+      m_sig_score_offset.push_back(m_sig_score.size());
+    }
+    m_word_score.clear();
+    m_word_score_offset.clear(); m_word_score_offset.reserve(m_word.size() + 1);
+    m_word_score_offset.push_back(0);
+    for (word_t i = 0; i != m_word.size(); ++i)
+    {
+      if (!smooth(i))
+      {
+        weights.clear(); word_score(i, std::back_inserter(weights), false);
+        to_chart(weights, std::back_inserter(m_word_score));
+      }
+      m_word_score_offset.push_back(m_word_score.size());
+    }
+  }
+
 public:
 
   lexicon(const state_list & states) : m_states(states), m_known(0), m_unknown(0) {}
@@ -252,35 +345,11 @@ public:
       }
     }
     // get state|word
-    {
-      word_t word;
-      std::pair< state_t, count_t > state_count;
-      m_word.clear(); m_word.resize(max_word + 1);
-      m_word_state.clear(); m_word_state.resize(max_word + 1);
-      m_known_state.clear(); m_known_state.resize(m_states.size());
-      while (word_state_in >> word >> state_count.first >> state_count.second)
-      {
-        m_word[word] += state_count.second;
-        m_word_state[word].push_back(state_count);
-        m_known_state[state_count.first] += state_count.second;
-        m_known += state_count.second;
-      }
-    }
+    m_known = 0;
+    load_state_counts(word_state_in, max_word, m_word_offset, m_word_state, m_word, m_known_state, m_known);
     // get state|sig
-    {
-      word_t sig;
-      std::pair< state_t, count_t > state_count;
-      m_sig.clear(); m_sig.resize(max_sig + 1);
-      m_sig_state.clear(); m_sig_state.resize(max_sig + 1);
-      m_unknown_state.clear(); m_unknown_state.resize(m_states.size());
-      while (sig_state_in >> sig >> state_count.first >> state_count.second)
-      {
-        m_sig[sig] += state_count.second;
-        m_sig_state[sig].push_back(state_count);
-        m_unknown_state[state_count.first] += state_count.second;
-        m_unknown += state_count.second;
-      }
-    }
+    m_unknown = 0;
+    load_state_counts(sig_state_in, max_sig, m_sig_offset, m_sig_state, m_sig, m_unknown_state, m_unknown);
     // fill m_any
     m_any.clear();
     for (state_t i = 0; i != m_states.size(); ++i)
@@ -290,10 +359,7 @@ public:
     }
     // sort our state counts by state
     std::sort(m_open_class.begin(), m_open_class.end(), cmp_state_t_count_t());
-    for (std::vector< std::vector< std::pair< state_t, count_t > > >::iterator it = m_word_state.begin(); it != m_word_state.end(); ++it)
-      std::sort(it->begin(), it->end(), cmp_state_t_count_t());
-    for (std::vector< std::vector< std::pair< state_t, count_t > > >::iterator it = m_sig_state.begin(); it != m_sig_state.end(); ++it)
-      std::sort(it->begin(), it->end(), cmp_state_t_count_t());
+    precompute_scores();
   }
 
   template <class OutputIterator>
@@ -301,9 +367,53 @@ public:
   {
     boost::unordered_map< std::string, word_t >::iterator it_w = m_word_index.find(word);
     if (it_w != m_word_index.end() && m_word[it_w->second] > 0) // have we seen this word?
-      word_score(it_w->second, out, m_word[it_w->second] <= consts::smooth_threshold);
+      word_score(it_w->second, out, smooth(it_w->second));
+    else
+      sig_score(sig_index(word, pos), out);
+  }
+
+  // whether score can ever give a state: true of the preterminals, and only them
+  bool is_tag(state_t state) const
+  {
+    return m_known_state[state] > 0 || m_unknown_state[state] > 0 || m_states[state].open_class;
+  }
+
+  // how many states a word can take: a cheap measure of how much it adds to a parse
+  size_t ambiguity(const std::string & word, int pos = -1)
+  {
+    boost::unordered_map< std::string, word_t >::iterator it_w = m_word_index.find(word);
+    if (it_w != m_word_index.end() && m_word[it_w->second] > 0)
+    {
+      word_t w = it_w->second;
+      return smooth(w) ? m_word_offset[w + 1] - m_word_offset[w] + m_any.size() : m_word_score_offset[w + 1] - m_word_score_offset[w];
+    }
+    word_t s = sig_index(word, pos);
+    return m_sig_score_offset[s + 1] - m_sig_score_offset[s];
+  }
+
+  // same as score, but emits state_score_t already scaled by score_resolution,
+  // ready to be handed to the parser.  sigs and frequent words are a straight copy
+  template <class OutputIterator>
+  void chart_score(const std::string & word, OutputIterator out, int pos = -1)
+  {
+    boost::unordered_map< std::string, word_t >::iterator it_w = m_word_index.find(word);
+    if (it_w != m_word_index.end() && m_word[it_w->second] > 0)
+    {
+      word_t w = it_w->second;
+      if (smooth(w))
+      {
+        std::vector< std::pair< state_t, float > > weights;
+        word_score(w, std::back_inserter(weights), true);
+        to_chart(weights, out);
+      }
+      else
+        std::copy(m_word_score.begin() + m_word_score_offset[w], m_word_score.begin() + m_word_score_offset[w + 1], out);
+    }
     else
-      sig_score(word, out, pos);
+    {
+      word_t s = sig_index(word, pos);
+      std::copy(m_sig_score.begin() + m_sig_score_offset[s], m_sig_score.begin() + m_sig_score_offset[s + 1], out);
+    }
   }
 };
 
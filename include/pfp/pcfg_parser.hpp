@@ -4,7 +4,10 @@
 #include <vector>
 #include <exception>
 #include <limits>
+#include <stdexcept>
+#include <ostream>
 #include <boost/shared_ptr.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 #include <pfp/util.hpp>
 #include <pfp/binary_grammar.hpp>
@@ -13,6 +16,63 @@
 
 namespace com { namespace wavii { namespace pfp {
 
+// thrown when a parse runs past its deadline.  the workspace may be left
+// partly filled, and is good for the next parse as is
+class parse_timeout : public std::runtime_error
+{
+public:
+  parse_timeout() : std::runtime_error("parse timed out") {}
+};
+
+// counts of the work a parse does, to explain why one sentence parses slower than
+// another of the same length.  pass one to parse to have it filled in
+struct parse_stats
+{
+  static const bool enabled = true;
+
+  size_t cells;            // spans visited
+  size_t seen_states;      // left children considered for binary rules, summed over spans
+  size_t binary_rules;     // binary rules scanned
+  size_t binary_pruned;    // binary rules skipped by the extent check
+  size_t splits;           // split points tried
+  size_t puts_new;         // states scored for the first time in a span
+  size_t puts_updated;     // states rescored higher
+  size_t puts_ignored;     // states offered a score no better than they had
+  size_t unaries;          // unary rules that applied
+  size_t backtrace_steps;  // tree nodes read back
+
+  parse_stats() { clear(); }
+
+  void clear()
+  {
+    cells = seen_states = binary_rules = binary_pruned = splits = 0;
+    puts_new = puts_updated = puts_ignored = unaries = backtrace_steps = 0;
+  }
+
+  parse_stats & operator+=(const parse_stats & rhs)
+  {
+    cells += rhs.cells; seen_states += rhs.seen_states;
+    binary_rules += rhs.binary_rules; binary_pruned += rhs.binary_pruned; splits += rhs.splits;
+    puts_new += rhs.puts_new; puts_updated += rhs.puts_updated; puts_ignored += rhs.puts_ignored;
+    unaries += rhs.unaries; backtrace_steps += rhs.backtrace_steps;
+    return *this;
+  }
+};
+
+// counts nothing: every count is behind a test of enabled, so the compiler drops them all
+struct no_parse_stats : public parse_stats
+{
+  static const bool enabled = false;
+};
+
+inline std::ostream & operator<<(std::ostream & out, const parse_stats & s)
+{
+  return out << "cells=" << s.cells << " seen_states=" << s.seen_states
+             << " binary_rules=" << s.binary_rules << " binary_pruned=" << s.binary_pruned << " splits=" << s.splits
+             << " puts_new=" << s.puts_new << " puts_updated=" << s.puts_updated << " puts_ignored=" << s.puts_ignored
+             << " unaries=" << s.unaries << " backtrace_steps=" << s.backtrace_steps;
+}
+
 // exhaustive parser for a probabilistic context-free grammar
 // exploits dynamic programming to iteratively score every
 // possible state for every possible span of tags, in a bottom-up
@@ -26,54 +86,121 @@ private:
   const unary_grammar &  m_ug;     // our unary grammar rules
   const binary_grammar & m_bg;     // our binary grammar rules
 
-  void best_parse(node & tree, const std::vector< std::vector< state_score_t > > & sentence, workspace & ws, pos_t begin, pos_t end)
+  // ws.put, counting whether the score was new, better, or no better
+  template<class Workspace, class Stats>
+  static void put(Workspace & ws, pos_t begin, pos_t end, state_t state, score_t score, Stats & stats)
   {
-    tree.score = ws.get(begin, end, tree.state);
+    if (Stats::enabled)
+    {
+      score_t old = ws.get(begin, end, state);
+      if (old == consts::empty_score)
+        ++stats.puts_new;
+      else if (old < score)
+        ++stats.puts_updated;
+      else
+        ++stats.puts_ignored;
+    }
+    ws.put(begin, end, state, score);
+  }
 
+  // how the best parse of a state over a span was made: from a word, by a unary rule from child, or by a binary
+  // rule from child over [begin, split) and rite over [split, end)
+  enum rule_t { word_rule, unary_rule, binary_rule };
+
+  template<class Workspace>
+  rule_t best_rule(state_t state, score_t score, const std::vector< std::vector< state_score_t > > & sentence, Workspace & ws,
+                   pos_t begin, pos_t end, state_t & child, state_t & rite, pos_t & split)
+  {
     if (end - begin == 1)
     {
       // are we perhaps at a terminal state?
-      std::vector< state_score_t >::const_iterator it_ts = std::lower_bound(sentence[begin].begin(), sentence[begin].end(), state_score_t(tree.state, 0));
-      if (it_ts != sentence[begin].end() && it_ts->state == tree.state)
-        return;
+      std::vector< state_score_t >::const_iterator it_ts = std::lower_bound(sentence[begin].begin(), sentence[begin].end(), state_score_t(state, 0));
+      if (it_ts != sentence[begin].end() && it_ts->state == state)
+        return word_rule;
     }
 
     // first check binary rules
     binary_grammar::const_iterator it_br, beg_br, end_br;
-    score_t split;
     if (begin == 0 && end == sentence.size()) // ah, the boundary symbol rules
       beg_br = m_bg.boundary_begin(), end_br = m_bg.boundary_end(), split = end - 1;
     else
-      beg_br = m_bg.get_rules_parent(tree.state).begin(), end_br = m_bg.get_rules_parent(tree.state).end(), split = begin + 1;
+      beg_br = m_bg.get_rules_parent(state).begin(), end_br = m_bg.get_rules_parent(state).end(), split = begin + 1;
     for (; split != end; ++split)
     {
       for (it_br = beg_br; it_br != end_br; ++it_br)
       {
-        if (std::abs(it_br->result.score + ws.get(begin, split, it_br->left) + ws.get(split, end, it_br->rite) - tree.score) <= consts::epsilon)
+        if (std::abs(it_br->result.score + ws.get(begin, split, it_br->left) + ws.get(split, end, it_br->rite) - score) <= consts::epsilon)
         {
-          tree.children.push_back(boost::shared_ptr<node>(new node(it_br->left, 0)));
-          tree.children.push_back(boost::shared_ptr<node>(new node(it_br->rite, 0)));
-          best_parse(*tree.children[0], sentence, ws, begin, split);
-          best_parse(*tree.children[1], sentence, ws, split, end);
-          return;
+          child = it_br->left;
+          rite = it_br->rite;
+          return binary_rule;
         }
       }
     }
     // now check unary rules, with non-closed grammar
-    unary_grammar::const_iterator it_ur = m_ug.get_rules_parent(tree.state).begin(), end_ur = m_ug.get_rules_parent(tree.state).end();
+    unary_grammar::const_iterator it_ur = m_ug.get_rules_parent(state).begin(), end_ur = m_ug.get_rules_parent(state).end();
     for (; it_ur != end_ur; ++it_ur)
     {
-      if (std::abs(it_ur->result.score + ws.get(begin, end, it_ur->child) - tree.score) <= consts::epsilon)
+      if (std::abs(it_ur->result.score + ws.get(begin, end, it_ur->child) - score) <= consts::epsilon)
       {
-        tree.children.push_back(boost::shared_ptr<node>(new node(it_ur->child, 0)));
-        best_parse(*tree.children[0], sentence, ws, begin, end);
-        return;
+        child = it_ur->child;
+        return unary_rule;
       }
     }
     // kill screen!
     throw std::runtime_error("game over, man!");
   }
 
+  template<class Workspace, class Stats>
+  void best_parse(node & tree, const std::vector< std::vector< state_score_t > > & sentence, Workspace & ws, pos_t begin, pos_t end, Stats & stats)
+  {
+    if (Stats::enabled)
+      ++stats.backtrace_steps;
+    tree.score = ws.get(begin, end, tree.state);
+    state_t child, rite;
+    pos_t split;
+    switch (best_rule(tree.state, tree.score, sentence, ws, begin, end, child, rite, split))
+    {
+    case word_rule:
+      break;
+    case unary_rule:
+      tree.children.push_back(boost::shared_ptr<node>(new node(child, 0)));
+      best_parse(*tree.children[0], sentence, ws, begin, end, stats);
+      break;
+    case binary_rule:
+      tree.children.push_back(boost::shared_ptr<node>(new node(child, 0)));
+      tree.children.push_back(boost::shared_ptr<node>(new node(rite, 0)));
+      best_parse(*tree.children[0], sentence, ws, begin, split, stats);
+      best_parse(*tree.children[1], sentence, ws, split, end, stats);
+      break;
+    }
+  }
+
+  // best_parse without the tree: walk the same backpointers, collecting the spans of states marked in wanted
+  template<class Workspace, class Stats>
+  void best_spans(state_t state, const std::vector< std::vector< state_score_t > > & sentence, Workspace & ws, pos_t begin, pos_t end,
+                  const std::vector< bool > & wanted, std::vector< span > & spans, Stats & stats)
+  {
+    if (Stats::enabled)
+      ++stats.backtrace_steps;
+    if (wanted[state])
+      spans.push_back(span(state, begin, end));
+    state_t child, rite;
+    pos_t split;
+    switch (best_rule(state, ws.get(begin, end, state), sentence, ws, begin, end, child, rite, split))
+    {
+    case word_rule:
+      break;
+    case unary_rule:
+      best_spans(child, sentence, ws, begin, end, wanted, spans, stats);
+      break;
+    case binary_rule:
+      best_spans(child, sentence, ws, begin, split, wanted, spans, stats);
+      best_spans(rite, sentence, ws, split, end, wanted, spans, stats);
+      break;
+    }
+  }
+
   void debinarize(node & tree)
   {
     // our grammar produces only binary and unary relations, and represents
@@ -100,11 +227,50 @@ public:
 
   // return true if a parse was found, and populate result tree
   // sentence word clouds must be sorted by state
-  // workspace must be of adequate size for sentence length
+  // workspace must be of adequate size for sentence length: a workspace, or a sparse_workspace for long sentences
+  // throws parse_timeout if deadline (utc) passes before the chart is filled
+  template<class Workspace>
   bool parse( const std::vector< std::vector< state_score_t > > & sentence,
-              workspace & ws,
-              node & tree )
+              Workspace & ws,
+              node & tree,
+              const boost::posix_time::ptime & deadline = boost::posix_time::ptime(boost::posix_time::pos_infin) )
   {
+    no_parse_stats stats;
+    return parse(sentence, ws, tree, deadline, stats);
+  }
+
+  // parse, adding up the work done in stats
+  template<class Workspace, class Stats>
+  bool parse( const std::vector< std::vector< state_score_t > > & sentence,
+              Workspace & ws,
+              node & tree,
+              const boost::posix_time::ptime & deadline,
+              Stats & stats )
+  {
+    if (!fill(sentence, ws, deadline, stats))
+      return false;
+    backtrace(sentence, ws, tree, stats);
+    return true;
+  }
+
+  // the first half of parse: score every state over every span into the workspace.
+  // return true if the goal state spans the sentence, and so a parse can be read back
+  template<class Workspace>
+  bool fill( const std::vector< std::vector< state_score_t > > & sentence,
+             Workspace & ws,
+             const boost::posix_time::ptime & deadline = boost::posix_time::ptime(boost::posix_time::pos_infin) )
+  {
+    no_parse_stats stats;
+    return fill(sentence, ws, deadline, stats);
+  }
+
+  template<class Workspace, class Stats>
+  bool fill( const std::vector< std::vector< state_score_t > > & sentence,
+             Workspace & ws,
+             const boost::posix_time::ptime & deadline,
+             Stats & stats )
+  {
+    bool timed = !deadline.is_pos_infinity();
     pos_t sentence_size = static_cast<pos_t>(sentence.size());
     if ( sentence.size() > ws.words )
     {
@@ -116,7 +282,14 @@ public:
     // initialize our workspace
     ws.clear(sentence_size);
     for (size_t i = 0; i != sentence.size(); ++i)
-      ws.put(i, i + 1, sentence[i].begin(), sentence[i].end()); // provide the initial state from the sentence
+    {
+      // provide the initial state from the sentence
+      for (std::vector< state_score_t >::const_iterator it = sentence[i].begin(); it != sentence[i].end(); ++it)
+        put(ws, i, i + 1, it->state, it->score, stats);
+    }
+    // only check the time once the words are in, so even a chart out of time has fragments to offer
+    if (timed && boost::posix_time::microsec_clock::universal_time() > deadline)
+      throw parse_timeout();
 
     // hokay!  look inside ever-widening ranges for subranges that match unary/binary rules
     pos_t rsize, rbegin, rend, rsplit, rsplit_end;
@@ -129,8 +302,14 @@ public:
     {
       for (rbegin = 0, rend = rbegin + rsize; rend != sentence_size; ++rend, ++rbegin)
       {
+        if (timed && boost::posix_time::microsec_clock::universal_time() > deadline)
+          throw parse_timeout();
+        if (Stats::enabled)
+          ++stats.cells;
         if (rsize > 1)
         {
+          if (Stats::enabled)
+            stats.seen_states += ws.seen_states[rbegin].size();
           // first do binary rules
           // check states that have narrow extents that potentially leave space for a child after
           for (i_ne = 0, sz_ne = ws.seen_states[rbegin].size(); i_ne != sz_ne; ++i_ne)
@@ -141,12 +320,20 @@ public:
             for (it_r = m_bg.get_rules(left).begin(), end_r = m_bg.get_rules(left).end(); it_r != end_r; ++it_r)
             {
               bounds & bl = ws.left_extents[rend][it_r->rite];
+              if (Stats::enabled)
+                ++stats.binary_rules;
               // do these left extents potentially leave space AND potentially reach far enough?
               if (bl.narrow < br.narrow || bl.wide > br.wide)
+              {
+                if (Stats::enabled)
+                  ++stats.binary_pruned;
                 continue;
+              }
               // okay, search a split from the earliest one could begin to the latest
               rsplit = std::max(br.narrow, bl.wide);
               rsplit_end = std::min(br.wide, bl.narrow);
+              if (Stats::enabled && rsplit <= rsplit_end)
+                stats.splits += rsplit_end - rsplit + 1;
               result = consts::empty_score;
               for (; rsplit <= rsplit_end; ++rsplit)
               {
@@ -155,7 +342,7 @@ public:
                   result = val;
               }
               if (result != consts::empty_score)
-                ws.put(rbegin, rend, it_r->result.state, it_r->result.score + result);
+                put(ws, rbegin, rend, it_r->result.state, it_r->result.score + result, stats);
             }
           } // binary rules
         }
@@ -164,7 +351,11 @@ public:
         {
           result = ws.get(rbegin, rend, it_ur->child);
           if (result != consts::empty_score)
-            ws.put(rbegin, rend, it_ur->result.state, result + it_ur->result.score);
+          {
+            if (Stats::enabled)
+              ++stats.unaries;
+            put(ws, rbegin, rend, it_ur->result.state, result + it_ur->result.score, stats);
+          }
         } // unary rules
       } // rbegin
     } // rsize
@@ -178,18 +369,145 @@ public:
     {
       left_score = ws.get(rbegin, rsplit, it_r->left);
       if (left_score != consts::empty_score)
-        ws.put(rbegin, rend, it_r->result.state, left_score + boundary_score + it_r->result.score);
+        put(ws, rbegin, rend, it_r->result.state, left_score + boundary_score + it_r->result.score, stats);
     }
 
-    if (ws.get(rbegin, rend, consts::goal_state) != consts::empty_score)
+    return ws.get(rbegin, rend, consts::goal_state) != consts::empty_score;
+  }
+
+  // the second half of parse: read the best tree back out of a workspace that fill
+  // found a parse in
+  template<class Workspace>
+  void backtrace( const std::vector< std::vector< state_score_t > > & sentence,
+                  Workspace & ws,
+                  node & tree )
+  {
+    no_parse_stats stats;
+    backtrace(sentence, ws, tree, stats);
+  }
+
+  template<class Workspace, class Stats>
+  void backtrace( const std::vector< std::vector< state_score_t > > & sentence,
+                  Workspace & ws,
+                  node & tree,
+                  Stats & stats )
+  {
+    tree.state = consts::goal_state;
+    best_parse(tree, sentence, ws, 0, static_cast<pos_t>(sentence.size()), stats);
+    debinarize(tree);
+  }
+
+  // backtrace for when only some constituents are wanted: collect the spans of the states marked in
+  // wanted (see state_list::select), outermost first, without building a tree or any strings.
+  // they're the spans backtrace's tree would have
+  template<class Workspace>
+  void spans( const std::vector< std::vector< state_score_t > > & sentence,
+              Workspace & ws,
+              const std::vector< bool > & wanted,
+              std::vector< span > & spans )
+  {
+    no_parse_stats stats;
+    this->spans(sentence, ws, wanted, spans, stats);
+  }
+
+  template<class Workspace, class Stats>
+  void spans( const std::vector< std::vector< state_score_t > > & sentence,
+              Workspace & ws,
+              const std::vector< bool > & wanted,
+              std::vector< span > & spans,
+              Stats & stats )
+  {
+    spans.clear();
+    best_spans(consts::goal_state, sentence, ws, 0, static_cast<pos_t>(sentence.size()), wanted, spans, stats);
+  }
+
+  // the fallback for when fill finds no parse, or runs out of time: read back the fewest
+  // constituents that cover the sentence between them, breaking ties by score, out of
+  // whatever the workspace holds.  spans are filled shortest first, so a chart that timed
+  // out holds every constituent up to some length.  the fragments are joined under
+  // (ROOT (FRAG ...)), which the grammar never produces itself
+  template<class Workspace>
+  void fragments( const std::vector< std::vector< state_score_t > > & sentence,
+                  Workspace & ws,
+                  node & tree )
+  {
+    no_parse_stats stats;
+    fragments(sentence, ws, tree, stats);
+  }
+
+  template<class Workspace, class Stats>
+  void fragments( const std::vector< std::vector< state_score_t > > & sentence,
+                  Workspace & ws,
+                  node & tree,
+                  Stats & stats )
+  {
+    pos_t words = static_cast<pos_t>(sentence.size() - 1); // not the boundary
+    size_t width = words + 1;
+    // the best whole constituent over each span, end-major: best[end * width + begin]
+    std::vector< state_score_t > best(width * width, state_score_t(consts::goal_state, consts::empty_score));
+    for (pos_t begin = 0; begin != words; ++begin)
     {
-      tree.state = consts::goal_state;
-      best_parse(tree, sentence, ws, rbegin, rend);
-      debinarize(tree);
-      return true;
+      for (std::vector< state_t >::const_iterator it = ws.seen_states[begin].begin(); it != ws.seen_states[begin].end(); ++it)
+      {
+        if (m_states[*it].synthetic || *it == consts::goal_state || *it == consts::boundary_state)
+          continue;
+        const bounds & br = ws.rite_extents[begin][*it];
+        for (pos_t end = br.narrow; end <= br.wide && end <= words; ++end)
+        {
+          score_t score = ws.get(begin, end, *it);
+          state_score_t & b = best[end * width + begin];
+          if (score != consts::empty_score && (b.score == consts::empty_score || score > b.score))
+            b = state_score_t(*it, score);
+        }
+      }
     }
+    // shortest path from 0 to words, where each span with a constituent is an edge
+    std::vector< size_t > count(width, std::numeric_limits<size_t>::max());
+    std::vector< int > total(width, 0);
+    std::vector< pos_t > from(width, 0);
+    count[0] = 0;
+    for (pos_t end = 1; end <= words; ++end)
+    {
+      for (pos_t begin = 0; begin != end; ++begin)
+      {
+        const state_score_t & b = best[end * width + begin];
+        if (b.score == consts::empty_score || count[begin] == std::numeric_limits<size_t>::max())
+          continue;
+        if (count[begin] + 1 < count[end] || (count[begin] + 1 == count[end] && total[begin] + b.score > total[end]))
+        {
+          count[end] = count[begin] + 1;
+          total[end] = total[begin] + b.score;
+          from[end] = begin;
+        }
+      }
+    }
+    if (count[words] == std::numeric_limits<size_t>::max())
+      throw std::runtime_error("no fragments cover the sentence");
 
-    return false;
+    // read back each fragment, last first
+    std::vector< boost::shared_ptr< node > > frags;
+    for (pos_t end = words; end != 0; end = from[end])
+    {
+      pos_t begin = from[end];
+      boost::shared_ptr< node > frag(new node(best[end * width + begin].state, 0));
+      best_parse(*frag, sentence, ws, begin, end, stats);
+      debinarize(*frag);
+      frags.insert(frags.begin(), frag);
+    }
+    state_t frag_state;
+    if (!m_states.find_state("FRAG", frag_state))
+      frag_state = consts::goal_state;
+    tree.state = consts::goal_state;
+    tree.score = static_cast<score_t>(total[words]);
+    tree.children.clear();
+    if (frag_state == consts::goal_state)
+      tree.children.swap(frags);
+    else
+    {
+      tree.children.push_back(boost::shared_ptr< node >(new node(frag_state, tree.score)));
+      tree.children.back()->children.swap(frags);
+    }
+    tree.children.push_back(boost::shared_ptr< node >(new node(consts::boundary_state, 0)));
   }
 
   // return true if a parse was found, and populate result
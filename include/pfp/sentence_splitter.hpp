@@ -0,0 +1,118 @@
+#ifndef __SENTENCE_SPLITTER_HPP__
+#define __SENTENCE_SPLITTER_HPP__
+
+#include <vector>
+#include <string>
+#include <cctype>
+#include <boost/shared_ptr.hpp>
+
+#include <pfp/config.h>
+#include <pfp/util.hpp>
+#include <pfp/state_list.hpp>
+
+namespace com { namespace wavii { namespace pfp {
+
+// cuts very long sentences into segments that can be parsed on their own, and joins
+// the segments' parses back together.  a chart costs the cube of the sentence length,
+// so a few short charts are far cheaper than one long one, and can be filled in parallel.
+// we only cut where a clause likely ends: after a semicolon, colon, or dash, or after a
+// comma that's followed by a coordinating conjunction.  each segment is parsed as a
+// sentence of its own, and the parses are joined as (ROOT (S segment segment ...))
+class sentence_splitter
+{
+private:
+
+  size_t   m_threshold;   // only split sentences longer than this
+  size_t   m_min_segment; // and never into segments shorter than this
+  state_t  m_join_state;  // the state the segments are joined under
+
+  static std::string lower(const std::string & word)
+  {
+    std::string s(word);
+    for (std::string::iterator it = s.begin(); it != s.end(); ++it)
+      *it = static_cast<char>(tolower(static_cast<unsigned char>(*it)));
+    return s;
+  }
+
+  static bool is_conjunction(const std::string & word)
+  {
+    std::string w = lower(word);
+    return w == "and" || w == "but" || w == "or" || w == "nor" || w == "yet" || w == "so";
+  }
+
+  // can we cut between words[i - 1] and words[i]?
+  static bool can_cut(const std::vector< std::string > & words, size_t i)
+  {
+    const std::string & prev = words[i - 1];
+    if (prev == ";" || prev == ":" || prev == "--")
+      return true;
+    return prev == "," && is_conjunction(words[i]);
+  }
+
+public:
+
+  sentence_splitter(const state_list & states, size_t threshold = 40, size_t min_segment = 6)
+  : m_threshold(threshold), m_min_segment(min_segment), m_join_state(consts::goal_state)
+  {
+    // a clause under the root: a verb-bearing one if the grammar has it, as joined clauses are
+    for (state_list::const_iterator it = states.begin(); it != states.end(); ++it)
+    {
+      if (it->synthetic || it->tag.compare(0, 6, "S^ROOT") != 0)
+        continue;
+      if (m_join_state == consts::goal_state || it->tag == "S^ROOT-v")
+        m_join_state = it->index;
+      if (it->tag == "S^ROOT-v")
+        break;
+    }
+  }
+
+  size_t threshold() const { return m_threshold; }
+
+  // fill ends with where each segment ends, the last being words.size().  returns true if
+  // there's more than one segment: false if the sentence is short enough or has nowhere safe to cut
+  bool split(const std::vector< std::string > & words, std::vector< size_t > & ends) const
+  {
+    ends.clear();
+    if (words.size() > m_threshold)
+    {
+      for (size_t i = m_min_segment, begin = 0; i + m_min_segment <= words.size(); ++i)
+      {
+        if (i - begin >= m_min_segment && can_cut(words, i))
+        {
+          ends.push_back(i);
+          begin = i;
+        }
+      }
+    }
+    ends.push_back(words.size());
+    return ends.size() > 1;
+  }
+
+  // join the segments' parses, each as returned by pcfg_parser, into one parse of the whole sentence
+  void join(const std::vector< node > & segments, node & tree) const
+  {
+    tree.state = consts::goal_state;
+    tree.score = 0;
+    tree.children.clear();
+    boost::shared_ptr< node > top(new node(m_join_state, 0));
+    for (std::vector< node >::const_iterator it = segments.begin(); it != segments.end(); ++it)
+    {
+      tree.score += it->score;
+      // everything but the segment's boundary
+      for (std::vector< boost::shared_ptr< node > >::const_iterator jt = it->children.begin(); jt != it->children.end(); ++jt)
+      {
+        if ((*jt)->state != consts::boundary_state)
+          top->children.push_back(*jt);
+      }
+    }
+    if (m_join_state == consts::goal_state)
+      tree.children.swap(top->children);
+    else
+      tree.children.push_back(top);
+    tree.children.push_back(boost::shared_ptr< node >(new node(consts::boundary_state, 0)));
+  }
+};
+
+}}} // com::wavii::pfp
+
+#endif // __SENTENCE_SPLITTER_HPP__
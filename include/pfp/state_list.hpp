@@ -5,7 +5,9 @@
 #include <string>
 #include <fstream>
 #include <algorithm>
+#include <boost/unordered_map.hpp>
 
+#include <pfp/config.h>
 #include <pfp/util.hpp>
 
 namespace com { namespace wavii { namespace pfp {
@@ -20,22 +22,11 @@ public:
     state_t     index;
     bool        synthetic;   // state is for pcfg internal use
     bool        open_class;  // state is safe for lexicon sig. guessing
+    category_t  category;    // its basic category: see state_list::basic_category
     bool operator < (const state & other) const
     {
       return index < other.index;
     }
-    // removes functional modifiers of a state, markovizations, and other junk
-    std::string basic_category()
-    {
-      const char delims[] = {'=', '|', '#', '^', '~', '_'};
-      size_t i = 0;
-      for (; i != tag.size(); ++i)
-      {
-        if (std::find(delims, delims + sizeof(delims), tag[i]) != delims + sizeof(delims))
-          break;
-      }
-      return tag.substr(0, i);
-    }
   };
 
   typedef std::vector<state>::iterator iterator;
@@ -46,6 +37,9 @@ private:
 
   state_t m_size;
   std::vector< state > m_states;
+  std::vector< std::string > m_categories;                             // category => name
+  boost::unordered_map< std::string, category_t > m_category_index;   // name => category
+  boost::unordered_map< std::string, state_t > m_state_index;         // tag => state, of states the grammar keeps
 
 public:
 
@@ -68,9 +62,25 @@ public:
       s.open_class = (s.tag[0] == '+');
       if (s.open_class)
         s.tag = s.tag.substr(1);
+      // the basic category removes functional modifiers of a state, markovizations, and other junk.
+      // states share a few hundred of them between them, so each is kept once and numbered
+      const char delims[] = {'=', '|', '#', '^', '~', '_'};
+      std::string category = s.tag.substr(0, std::find_first_of(s.tag.begin(), s.tag.end(), delims, delims + sizeof(delims)) - s.tag.begin());
+      boost::unordered_map< std::string, category_t >::iterator it = m_category_index.find(category);
+      if (it == m_category_index.end())
+      {
+        it = m_category_index.insert(std::make_pair(category, static_cast< category_t >(m_categories.size()))).first;
+        m_categories.push_back(category);
+      }
+      s.category = it->second;
       m_states.push_back(s);
     }
     std::sort(m_states.begin(), m_states.end());
+    for (const_iterator it = m_states.begin(); it != m_states.end(); ++it)
+    {
+      if (!it->synthetic)
+        m_state_index.insert(std::make_pair(it->tag, it->index));
+    }
   }
 
   const state & operator[](int index) const { return m_states[index]; }
@@ -87,6 +97,60 @@ public:
 
   const_iterator end() const { return m_states.end(); }
 
+  // a state's basic category: its tag without functional modifiers, markovizations, and other junk
+  category_t category(state_t state) const { return m_states[state].category; }
+
+  const std::string & basic_category(state_t state) const { return m_categories[m_states[state].category]; }
+
+  // how many basic categories there are, numbered from 0
+  category_t categories() const { return static_cast< category_t >(m_categories.size()); }
+
+  const std::string & category_name(category_t category) const { return m_categories[category]; }
+
+  // find a basic category by name.  returns false if no state has it
+  bool find_category(const std::string & name, category_t & category) const
+  {
+    boost::unordered_map< std::string, category_t >::const_iterator it = m_category_index.find(name);
+    if (it == m_category_index.end())
+      return false;
+    category = it->second;
+    return true;
+  }
+
+  // find a state the grammar keeps, not a synthetic one, by its tag.  returns false if there's none
+  bool find_state(const std::string & tag, state_t & state) const
+  {
+    boost::unordered_map< std::string, state_t >::const_iterator it = m_state_index.find(tag);
+    if (it == m_state_index.end())
+      return false;
+    state = it->second;
+    return true;
+  }
+
+  // mark in mask the states whose basic category is one of categories, or one of them with a
+  // functional tag (NP takes in NP-TMP), leaving out synthetic states and the root and boundary.
+  // with no categories, mark them all
+  void select(const std::vector< std::string > & categories, std::vector< bool > & mask) const
+  {
+    // match the few hundred categories first, rather than every state
+    std::vector< bool > matched(m_categories.size(), categories.empty());
+    for (size_t c = 0; c != m_categories.size(); ++c)
+    {
+      const std::string & category = m_categories[c];
+      for (std::vector< std::string >::const_iterator it = categories.begin(); it != categories.end() && !matched[c]; ++it)
+      {
+        matched[c] = category.compare(0, it->size(), *it) == 0
+                     && (category.size() == it->size() || category[it->size()] == '-');
+      }
+    }
+    mask.assign(m_states.size(), false);
+    for (const_iterator it = m_states.begin(); it != m_states.end(); ++it)
+    {
+      if (!it->synthetic && it->index != consts::goal_state && it->index != consts::boundary_state)
+        mask[it->index] = matched[it->category];
+    }
+  }
+
 };
 
 }}} // com::wavii::pfp
@@ -0,0 +1,300 @@
+#ifndef __TAGGER_HPP__
+#define __TAGGER_HPP__
+
+#include <vector>
+#include <string>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+#include <pfp/config.h>
+#include <pfp/util.hpp>
+#include <pfp/state_list.hpp>
+#include <pfp/lexicon.hpp>
+#include <pfp/unary_grammar.hpp>
+#include <pfp/binary_grammar.hpp>
+
+namespace com { namespace wavii { namespace pfp {
+
+// part-of-speech tagging without a chart: a bigram hidden markov model over the grammar's
+// preterminals, scored by the lexicon and decoded by viterbi.  we have no tagged corpus to
+// count tag bigrams from, so we derive them from the grammar itself: two tags are adjacent
+// wherever a rule's left child ends in one and its right child begins with the other, so a
+// tag bigram is weighed by how often we'd expect each rule to be used, times how likely its
+// left child is to end in the first tag, times how likely its right child is to begin with the second
+class tagger
+{
+private:
+
+  const state_list &      m_states;
+  lexicon &               m_lexicon;
+  const unary_grammar &   m_ug;
+  const binary_grammar &  m_bg;
+  std::vector< state_t >  m_tags;   // tag index => state
+  std::vector< int >      m_index;  // state => tag index, or -1 if it isn't a tag
+  std::vector< float >    m_start;  // tag index => log P(tag | start of sentence)
+  std::vector< float >    m_trans;  // from * tags + to => log P(to | from).  the boundary tag ends a sentence
+  std::vector< float >    m_mass;   // state => the sum of its rules' weights
+
+  // the chance of a transition we never derived, so viterbi always has a path
+  static float floor_score() { return -30.0f; }
+
+  // the model converges slowly but tags about as well after a few passes as after a hundred
+  static const int max_passes = 10;
+
+  // the chance a state rewrites by a rule.  compacted grammars merge states, so a state's
+  // rule weights needn't sum to one: we normalize them, so the grammar makes a proper distribution
+  float prob(state_t parent, score_t score) const
+  {
+    return std::exp(score / consts::score_resolution) / m_mass[parent];
+  }
+
+  // a state's rules, taking in the goal state's, which are kept apart from the rest
+  void rules_parent(state_t s, binary_grammar::const_iterator & begin, binary_grammar::const_iterator & end) const
+  {
+    if (s == consts::goal_state)
+      begin = m_bg.boundary_begin(), end = m_bg.boundary_end();
+    else
+      begin = m_bg.get_rules_parent(s).begin(), end = m_bg.get_rules_parent(s).end();
+  }
+
+  void masses()
+  {
+    m_mass.assign(m_states.size(), 0.0f);
+    binary_grammar::const_iterator it, end;
+    for (state_t s = 0; s != m_states.size(); ++s)
+    {
+      for (rules_parent(s, it, end); it != end; ++it)
+        m_mass[s] += std::exp(it->result.score / consts::score_resolution);
+      const std::vector< unary_grammar::relationship > & urs = m_ug.get_rules_parent(s);
+      for (std::vector< unary_grammar::relationship >::const_iterator ut = urs.begin(); ut != urs.end(); ++ut)
+        m_mass[s] += std::exp(ut->result.score / consts::score_resolution);
+      if (m_mass[s] == 0.0f)
+        m_mass[s] = 1.0f;
+    }
+  }
+
+  // for every state, the distribution of the tag at one edge of what it spans: its left
+  // corner if left, else its right.  corners[state * tags + tag]
+  void corners(bool left, std::vector< float > & corners) const
+  {
+    size_t tags = m_tags.size();
+    corners.assign(static_cast< size_t >(m_states.size()) * tags, 0.0f);
+    for (size_t t = 0; t != tags; ++t)
+      corners[m_tags[t] * tags + t] = 1.0f;
+    // rules can recurse down an edge (NP -> NP PP), so iterate until nothing much changes
+    std::vector< float > sum(tags);
+    for (int pass = 0; pass != max_passes; ++pass)
+    {
+      float change = 0.0f;
+      for (state_t s = 0; s != m_states.size(); ++s)
+      {
+        if (m_index[s] != -1)
+          continue;
+        float * to = &corners[s * tags];
+        std::fill(sum.begin(), sum.end(), 0.0f);
+        binary_grammar::const_iterator it, end;
+        for (rules_parent(s, it, end); it != end; ++it)
+        {
+          float p = prob(s, it->result.score);
+          const float * from = &corners[(left ? it->left : it->rite) * tags];
+          for (size_t t = 0; t != tags; ++t)
+            sum[t] += p * from[t];
+        }
+        const std::vector< unary_grammar::relationship > & urs = m_ug.get_rules_parent(s);
+        for (std::vector< unary_grammar::relationship >::const_iterator ut = urs.begin(); ut != urs.end(); ++ut)
+        {
+          float p = prob(s, ut->result.score);
+          const float * from = &corners[ut->child * tags];
+          for (size_t t = 0; t != tags; ++t)
+            sum[t] += p * from[t];
+        }
+        for (size_t t = 0; t != tags; ++t)
+        {
+          change = std::max(change, std::abs(sum[t] - to[t]));
+          to[t] = sum[t];
+        }
+      }
+      if (change < 1e-3f)
+        break;
+    }
+  }
+
+  // how often we'd expect each state to appear in a sentence's parse
+  void expected_counts(std::vector< float > & counts) const
+  {
+    counts.assign(m_states.size(), 0.0f);
+    for (int pass = 0; pass != max_passes; ++pass)
+    {
+      std::vector< float > next(m_states.size(), 0.0f);
+      next[consts::goal_state] = 1.0f;
+      for (state_t s = 0; s != m_states.size(); ++s)
+      {
+        if (counts[s] == 0.0f)
+          continue;
+        binary_grammar::const_iterator it, end;
+        for (rules_parent(s, it, end); it != end; ++it)
+        {
+          next[it->left] += counts[s] * prob(s, it->result.score);
+          next[it->rite] += counts[s] * prob(s, it->result.score);
+        }
+        const std::vector< unary_grammar::relationship > & urs = m_ug.get_rules_parent(s);
+        for (std::vector< unary_grammar::relationship >::const_iterator ut = urs.begin(); ut != urs.end(); ++ut)
+          next[ut->child] += counts[s] * prob(s, ut->result.score);
+      }
+      float change = 0.0f;
+      for (state_t s = 0; s != m_states.size(); ++s)
+        change = std::max(change, std::abs(next[s] - counts[s]) / std::max(next[s], 1.0f));
+      counts.swap(next);
+      if (change < 1e-3f)
+        break;
+    }
+  }
+
+  // count the right corners of left as adjacent to the tags in rite, as weighed there
+  void adjacent(const std::vector< float > & rcs, state_t left, const std::vector< float > & rite,
+                std::vector< float > & bigrams) const
+  {
+    size_t tags = m_tags.size();
+    for (size_t a = 0; a != tags; ++a)
+    {
+      float ra = rcs[left * tags + a];
+      if (ra < 1e-7f)
+        continue;
+      float * to = &bigrams[a * tags];
+      for (size_t b = 0; b != tags; ++b)
+        to[b] += ra * rite[b];
+    }
+  }
+
+public:
+
+  tagger(const state_list & states, lexicon & lexicon, const unary_grammar & ug, const binary_grammar & bg)
+  : m_states(states), m_lexicon(lexicon), m_ug(ug), m_bg(bg)
+  {
+  }
+
+  // derive the tag model from the grammar.  call once the states, lexicon, and grammars are loaded.
+  // takes a second or so, and some memory while it works
+  void init()
+  {
+    m_tags.clear();
+    m_index.assign(m_states.size(), -1);
+    for (state_t s = 0; s != m_states.size(); ++s)
+    {
+      if (m_lexicon.is_tag(s))
+      {
+        m_index[s] = static_cast< int >(m_tags.size());
+        m_tags.push_back(s);
+      }
+    }
+    size_t tags = m_tags.size();
+    masses();
+    std::vector< float > lcs, rcs, counts;
+    corners(true, lcs);
+    corners(false, rcs);
+    expected_counts(counts);
+
+    // count adjacent tags across every rule, gathering the rules that share a left child
+    std::vector< float > bigrams(tags * tags, 0.0f), rite(tags);
+    for (state_t s = 0; s != m_states.size(); ++s)
+    {
+      const std::vector< binary_grammar::relationship > & brs = m_bg.get_rules(s);
+      if (brs.empty())
+        continue;
+      std::fill(rite.begin(), rite.end(), 0.0f);
+      for (std::vector< binary_grammar::relationship >::const_iterator it = brs.begin(); it != brs.end(); ++it)
+      {
+        float w = counts[it->result.state] * prob(it->result.state, it->result.score);
+        const float * from = &lcs[it->rite * tags];
+        for (size_t t = 0; t != tags; ++t)
+          rite[t] += w * from[t];
+      }
+      adjacent(rcs, s, rite, bigrams);
+    }
+    // and the sentence's last tag against the boundary
+    for (binary_grammar::const_iterator it = m_bg.boundary_begin(); it != m_bg.boundary_end(); ++it)
+    {
+      std::fill(rite.begin(), rite.end(), 0.0f);
+      rite[m_index[it->rite]] = prob(consts::goal_state, it->result.score);
+      adjacent(rcs, it->left, rite, bigrams);
+    }
+
+    // normalize into log probabilities
+    m_trans.assign(tags * tags, floor_score());
+    for (size_t a = 0; a != tags; ++a)
+    {
+      float total = 0.0f;
+      for (size_t b = 0; b != tags; ++b)
+        total += bigrams[a * tags + b];
+      for (size_t b = 0; total > 0.0f && b != tags; ++b)
+      {
+        if (bigrams[a * tags + b] > 0.0f)
+          m_trans[a * tags + b] = std::max(std::log(bigrams[a * tags + b] / total), floor_score());
+      }
+    }
+    // a sentence starts with whatever the goal state's left corner is
+    m_start.assign(tags, floor_score());
+    float total = 0.0f;
+    for (size_t t = 0; t != tags; ++t)
+      total += lcs[consts::goal_state * tags + t];
+    for (size_t t = 0; total > 0.0f && t != tags; ++t)
+    {
+      if (lcs[consts::goal_state * tags + t] > 0.0f)
+        m_start[t] = std::max(std::log(lcs[consts::goal_state * tags + t] / total), floor_score());
+    }
+  }
+
+  // fill tags with the most likely tag of each word
+  void tag(const std::vector< std::string > & words, std::vector< state_t > & tags)
+  {
+    tags.clear();
+    if (words.empty())
+      return;
+    size_t num_tags = m_tags.size();
+    // each word's candidate tags, best score and backpointer for each, and the boundary to finish
+    std::vector< std::vector< std::pair< state_t, float > > > candidates(words.size() + 1);
+    std::vector< std::vector< float > > best(words.size() + 1);
+    std::vector< std::vector< size_t > > back(words.size() + 1);
+    for (size_t i = 0; i != words.size(); ++i)
+    {
+      m_lexicon.score(words[i], std::back_inserter(candidates[i]));
+      if (candidates[i].empty())
+        throw std::runtime_error("no tags for " + words[i]);
+    }
+    candidates.back().push_back(std::make_pair(consts::boundary_state, 0.0f));
+    for (size_t i = 0; i != candidates.size(); ++i)
+    {
+      best[i].resize(candidates[i].size(), -std::numeric_limits< float >::infinity());
+      back[i].resize(candidates[i].size(), 0);
+      for (size_t k = 0; k != candidates[i].size(); ++k)
+      {
+        size_t to = m_index[candidates[i][k].first];
+        if (i == 0)
+        {
+          best[i][k] = m_start[to] + candidates[i][k].second;
+          continue;
+        }
+        for (size_t j = 0; j != candidates[i - 1].size(); ++j)
+        {
+          float score = best[i - 1][j] + m_trans[m_index[candidates[i - 1][j].first] * num_tags + to] + candidates[i][k].second;
+          if (score > best[i][k])
+          {
+            best[i][k] = score;
+            back[i][k] = j;
+          }
+        }
+      }
+    }
+    // read back from the boundary
+    tags.resize(words.size());
+    for (size_t i = words.size(), k = back.back()[0]; i-- != 0; k = back[i][k])
+      tags[i] = candidates[i][k].first;
+  }
+};
+
+}}} // com::wavii::pfp
+
+#endif // __TAGGER_HPP__
@@ -4,10 +4,12 @@
 #include <vector>
 #include <string>
 #include <fstream>
-#include <boost/optional.hpp>
+#include <cstring>
+#include <strings.h>
+#include <limits>
+#include <algorithm>
+#include <boost/noncopyable.hpp>
 #include <boost/unordered_map.hpp>
-#include <boost/regex.hpp>
-#include <boost/algorithm/string/replace.hpp>
 
 namespace com { namespace wavii { namespace pfp {
 
@@ -17,112 +19,294 @@ class tokenizer
 {
 private:
 
-  struct replacement
+  boost::unordered_map<std::string, std::string> m_literals;
+  std::vector<bool>                              m_literal_ends;    // (first byte, last byte) => some literal has them
+  size_t                                         m_literal_min_len;
+  size_t                                         m_literal_max_len;
+
+  static bool ends_with(const std::string & in, const char * suffix, size_t len)
   {
-    boost::regex find;
-    std::string format;
-    boost::optional< boost::regex > unless;
-    replacement(std::string find_, std::string format_) : find(find_), format(format_) {}
-    replacement(std::string find_, std::string format_, std::string unless_) : find(find_), format(format_), unless(boost::regex(unless_)) {}
-  };
+    return in.size() >= len && in.compare(in.size() - len, len, suffix) == 0;
+  }
 
-  boost::unordered_map<std::string, std::string> m_literals;
-  std::vector< replacement >                     m_replacements;
+  // could in be one of our literals?  false positives are fine, the map has the final word
+  bool maybe_literal(const std::string & in) const
+  {
+    return    in.size() >= m_literal_min_len && in.size() <= m_literal_max_len
+           && m_literal_ends[static_cast<unsigned char>(in[0]) * 256 + static_cast<unsigned char>(in[in.size() - 1])];
+  }
+
+  // the rewrite rules below only ever delete a few letters, so we edit in place.
+  // every rule needs "aem", a trailing "our(s)" or a trailing "programme(s)"
+  // to fire, so almost every word bails out after one scan for "aem"
+
+  // (.*)haem(at)?o(.*) => $1hem$2o$3, rightmost occurrence
+  static bool rewrite_haemo(std::string & in, size_t aem)
+  {
+    for (size_t p = in.rfind("haem"); p != std::string::npos && p + 1 >= aem; p = p == 0 ? std::string::npos : in.rfind("haem", p - 1))
+    {
+      if (in.compare(p + 4, 1, "o") == 0 || in.compare(p + 4, 3, "ato") == 0)
+      {
+        in.erase(p + 1, 1);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // (.*)([lL]euk)aem(.*) => $1$2em$3, rightmost occurrence
+  static bool rewrite_leukaem(std::string & in, size_t aem)
+  {
+    for (size_t p = in.rfind("eukaem"); p != std::string::npos && p + 3 >= aem; p = p == 0 ? std::string::npos : in.rfind("eukaem", p - 1))
+    {
+      if (p > 0 && (in[p - 1] == 'l' || in[p - 1] == 'L'))
+      {
+        in.erase(p + 3, 1);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // ^([a-z]{3,})our(s?)$ => $1or$2, unless glamour|de[tv]our
+  static bool rewrite_our(std::string & in)
+  {
+    size_t stem = in.size() - (ends_with(in, "ours", 4) ? 4 : 3);
+    if (stem < 3 || in == "glamour" || in == "detour" || in == "devour")
+      return false;
+    for (size_t i = 0; i != stem; ++i)
+    {
+      if (in[i] < 'a' || in[i] > 'z')
+        return false;
+    }
+    in.erase(stem + 1, 1);
+    return true;
+  }
 
   // convert colour to color
   // british, canadian - doesn't matter.  deep down we're all american.
-  std::string americanize(const std::string & in) const
+  void americanize(const char * p, std::string & out) const
   {
-    boost::unordered_map<std::string, std::string>::const_iterator it_h = m_literals.find(in);
-    if (it_h != m_literals.end())
-      return it_h->second;
-    boost::smatch mr;
-    for (std::vector<replacement>::const_iterator it = m_replacements.begin(); it != m_replacements.end(); ++it)
+    out = p;
+    if (out.empty())
+      return;
+    if (maybe_literal(out))
     {
-      if (   !(it->unless && boost::regex_match(in, *it->unless))
-          && boost::regex_match(in, mr, it->find))
-        return mr.format(it->format);
+      boost::unordered_map<std::string, std::string>::const_iterator it_h = m_literals.find(out);
+      if (it_h != m_literals.end())
+      {
+        out = it_h->second;
+        return;
+      }
     }
-    return in;
+    size_t aem = out.find("aem");
+    if (aem != std::string::npos)
+    {
+      if (rewrite_haemo(out, aem))
+        return;
+      // (.*)aemia$ => $1emia
+      if (ends_with(out, "aemia", 5))
+      {
+        out.erase(out.size() - 5, 1);
+        return;
+      }
+      if (rewrite_leukaem(out, aem))
+        return;
+    }
+    // (.*)programme(s?)$ => $1program$2
+    if (ends_with(out, "programme", 9) || ends_with(out, "programmes", 10))
+      out.erase(out.rfind("programme") + 7, 2);
+    else if (ends_with(out, "our", 3) || ends_with(out, "ours", 4))
+      rewrite_our(out);
   }
 
-  // convert certain windows codepage peculiarities that we shouldn't
-  // have to see, but may crop up anyway
-  std::string cp1252_normalize(const std::string & in) const
-  {
-    std::string ret = in;
-    boost::algorithm::replace_all(ret, "&apos;", "'");
-    boost::algorithm::replace_all(ret, "\xc2\x91", "`");
-    boost::algorithm::replace_all(ret, "\xe2\x80\x98", "`");
-    boost::algorithm::replace_all(ret, "\xc2\x92", "'");
-    boost::algorithm::replace_all(ret, "\xe2\x80\x99", "'");
-    boost::algorithm::replace_all(ret, "\xc2\x93", "``");
-    boost::algorithm::replace_all(ret, "\xe2\x80\x9c", "``");
-    boost::algorithm::replace_all(ret, "\xc2\x94", "''");
-    boost::algorithm::replace_all(ret, "\xe2\x80\x9d", "''");
-    boost::algorithm::replace_all(ret, "\xc2\xbc", "1\\/4");
-    boost::algorithm::replace_all(ret, "\xc2\xbd", "1\\/2");
-    boost::algorithm::replace_all(ret, "\xc2\xbe", "3\\/4");
-    boost::algorithm::replace_all(ret, "\xc2\xa2", "cents");
-    boost::algorithm::replace_all(ret, "\xc2\xa3", "#");
-    boost::algorithm::replace_all(ret, "\xc2\x80", "$");
-    boost::algorithm::replace_all(ret, "\xe2\x82\xac", "$");  // Euro -- no good translation!
-    return ret;
-  }
+  struct mapping
+  {
+    const char * from;
+    const char * to;
+  };
 
-  // escape x -> \x
-  std::string escape(const std::string & in, char echar) const
+  // convert certain windows codepage peculiarities that we shouldn't
+  // have to see, but may crop up anyway.  one pass: only '&' and the utf-8
+  // lead bytes 0xc2, 0xe2 can start a mapping, everything else copies through
+  void cp1252_normalize(const char * in, std::string & out) const
   {
-    std::string ret = in;
-    std::string c(1, echar), ec = "\\" + c, eec = "\\\\" + c;
-    // change c -> \c
-    boost::algorithm::replace_all(ret, c, ec);
-    // change \\c -> \c
-    boost::algorithm::replace_all(ret, eec, ec);
-    return ret;
+    static const mapping mappings[] =
+    {
+      { "&apos;", "'" },
+      { "\xc2\x91", "`" },
+      { "\xe2\x80\x98", "`" },
+      { "\xc2\x92", "'" },
+      { "\xe2\x80\x99", "'" },
+      { "\xc2\x93", "``" },
+      { "\xe2\x80\x9c", "``" },
+      { "\xc2\x94", "''" },
+      { "\xe2\x80\x9d", "''" },
+      { "\xc2\xbc", "1\\/4" },
+      { "\xc2\xbd", "1\\/2" },
+      { "\xc2\xbe", "3\\/4" },
+      { "\xc2\xa2", "cents" },
+      { "\xc2\xa3", "#" },
+      { "\xc2\x80", "$" },
+      { "\xe2\x82\xac", "$" },  // Euro -- no good translation!
+      { 0, 0 } // Marks end of list.
+    };
+    out.reserve(out.size() + std::strlen(in));
+    while (*in)
+    {
+      const mapping * m = mappings;
+      bool lead = (*in == '&' || *in == '\xc2' || *in == '\xe2');
+      while (lead && m->from && std::strncmp(in, m->from, std::strlen(m->from)) != 0)
+        ++m;
+      if (lead && m->from)
+      {
+        out += m->to;
+        in += std::strlen(m->from);
+      }
+      else
+        out += *in++;
+    }
   }
 
-  std::string ampersandize(const std::string & in) const
+  // escape x -> \x, leaving already-escaped \x alone
+  void escape(const char * in, char echar, std::string & out) const
   {
-    return boost::algorithm::ireplace_all_copy(in, "&amp;", "&");
+    out.reserve(out.size() + 2 * std::strlen(in));
+    for (const char * p = in; *p; ++p)
+    {
+      if (*p == echar && (p == in || p[-1] != '\\'))
+        out += '\\';
+      out += *p;
+    }
   }
 
-  void init()
+  // &amp; -> &, case-insensitively
+  void ampersandize(const char * in, std::string & out) const
   {
-    m_replacements.push_back(replacement("(.*)haem(at)?o(.*)", "$1hem$2o$3"));
-    m_replacements.push_back(replacement("(.*)aemia$", "$1emia"));
-    m_replacements.push_back(replacement("(.*)([lL]euk)aem(.*)", "$1$2em$3"));
-    m_replacements.push_back(replacement("(.*)programme(s?)$", "$1program$2"));
-    m_replacements.push_back(replacement("^([a-z]{3,})our(s?)$", "$1or$2", "glamour|de[tv]our"));
+    out.reserve(out.size() + std::strlen(in));
+    while (*in)
+    {
+      if (*in == '&' && strncasecmp(in, "&amp;", 5) == 0)
+        out += '&', in += 5;
+      else
+        out += *in++;
+    }
   }
 
 public:
 
+  // a token by reference rather than by copy.  [begin, begin + size) are the bytes
+  // of the input the token was lexed from.  if the tokenizer left those bytes alone,
+  // they are also the token's text; otherwise the rewritten text (color, --, -LRB-, ...)
+  // lives at [text, text + text_size) of the arena passed to tokenize
+  struct span
+  {
+    size_t begin;
+    size_t size;
+    size_t text;
+    size_t text_size;
+    bool   normalized;
+    span(size_t begin_, size_t size_) : begin(begin_), size(size_), text(begin_), text_size(size_), normalized(false) {}
+    span(size_t begin_, size_t size_, size_t text_, size_t text_size_)
+    : begin(begin_), size(size_), text(text_), text_size(text_size_), normalized(true) {}
+
+    std::string str(const std::string & in, const std::string & arena) const
+    {
+      return normalized ? arena.substr(text, text_size) : in.substr(text, text_size);
+    }
+  };
+
+  // receives tokens from the lexer rules in etc/pfp/tokenizer.flex, either as strings
+  // or as spans.  the lexer calls match() with each rule's yytext before its action runs
   class tokenizer_out
   {
   private:
-    std::vector<std::string> & m_out;
+    std::vector<std::string> *         m_out;
+    std::vector<span> *                m_spans;
+    std::string *                      m_arena;
     const com::wavii::pfp::tokenizer & m_t;
+    const char *                       m_base;  // the lexer's copy of the input
+    const char *                       m_match; // what the current rule matched
+    size_t                             m_match_size;
+    std::string                        m_scratch;
+
+    // where to write the next token's text
+    std::string & next()
+    {
+      if (m_out)
+      {
+        m_out->push_back(std::string());
+        return m_out->back();
+      }
+      m_scratch.clear();
+      return m_scratch;
+    }
+
+    // record the token just written to next(), pointing back into the input if we can
+    void done()
+    {
+      if (!m_spans)
+        return;
+      size_t begin = m_match - m_base;
+      if (m_scratch.size() == m_match_size && m_scratch.compare(0, m_match_size, m_match, m_match_size) == 0)
+        m_spans->push_back(span(begin, m_match_size));
+      else
+      {
+        m_spans->push_back(span(begin, m_match_size, m_arena->size(), m_scratch.size()));
+        m_arena->append(m_scratch);
+      }
+    }
+
   public:
-    tokenizer_out(std::vector<std::string> & out, const com::wavii::pfp::tokenizer & t) : m_out(out), m_t(t) {}
-    void put(const char * p) { m_out.push_back(p); }
-    void put_american(const char * p) { m_out.push_back(m_t.americanize(p)); }
-    void put_cp1252(const char * p) { m_out.push_back(m_t.cp1252_normalize(p)); }
-    void put_escape(const char * p, char echar) { m_out.push_back(m_t.escape(p, echar)); }
-    void put_amp(const char * p) { m_out.push_back(m_t.ampersandize(p)); }
+    tokenizer_out(std::vector<std::string> & out, const com::wavii::pfp::tokenizer & t)
+    : m_out(&out), m_spans(0), m_arena(0), m_t(t), m_base(0), m_match(0), m_match_size(0) {}
+    tokenizer_out(std::vector<span> & spans, std::string & arena, const com::wavii::pfp::tokenizer & t)
+    : m_out(0), m_spans(&spans), m_arena(&arena), m_t(t), m_base(0), m_match(0), m_match_size(0) {}
+    void begin(const char * base) { m_base = base; }
+    void match(const char * p, size_t size) { m_match = p; m_match_size = size; }
+    void put(const char * p)
+    {
+      if (m_out)
+        m_out->push_back(p);
+      else if (p == m_match)
+        m_spans->push_back(span(m_match - m_base, m_match_size));
+      else
+        next() = p, done();
+    }
+    void put_american(const char * p) { m_t.americanize(p, next()); done(); }
+    void put_cp1252(const char * p) { m_t.cp1252_normalize(p, next()); done(); }
+    void put_escape(const char * p, char echar) { m_t.escape(p, echar, next()); done(); }
+    void put_amp(const char * p) { m_t.ampersandize(p, next()); done(); }
     void err(const char * p) { /* do zilch */ }
   };
 
   void tokenize(const std::string & in, std::vector<std::string> & out) const;
 
+  // tokenize without copying out each token: spans index into in, or into arena
+  // for tokens whose text was rewritten.  arena is appended to, never cleared
+  void tokenize(const std::string & in, std::vector<span> & out, std::string & arena) const;
+
+  // a lexer that is set up once and reused for many inputs, rather than
+  // paying for flex's setup and teardown on every call.  one per thread
+  class scanner : private boost::noncopyable
+  {
+  private:
+    void * m_scanner;
+  public:
+    scanner();
+    ~scanner();
+    // like tokenize, but over [in, in + size), which may hold embedded newlines or nuls
+    void tokenize(const tokenizer & t, const char * in, size_t size, std::vector<span> & out, std::string & arena);
+  };
+
   tokenizer()
+  : m_literal_ends(256 * 256), m_literal_min_len(1), m_literal_max_len(0)
   {
-    init();
   }
 
   tokenizer(const std::string & americanize_path)
+  : m_literal_ends(256 * 256), m_literal_min_len(1), m_literal_max_len(0)
   {
-    init();
     std::ifstream in(americanize_path.c_str());
     load(in);
   }
@@ -131,9 +315,17 @@ public:
   {
     std::pair< std::string, std::string > kv;
     m_literals.clear();
+    m_literal_ends.assign(256 * 256, false);
+    m_literal_min_len = std::numeric_limits<size_t>::max();
+    m_literal_max_len = 0;
     while (in >> kv.first >> kv.second)
+    {
       m_literals.insert(kv);
-   }
+      m_literal_ends[static_cast<unsigned char>(kv.first[0]) * 256 + static_cast<unsigned char>(kv.first[kv.first.size() - 1])] = true;
+      m_literal_min_len = std::min(m_literal_min_len, kv.first.size());
+      m_literal_max_len = std::max(m_literal_max_len, kv.first.size());
+    }
+  }
 };
 
 
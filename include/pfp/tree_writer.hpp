@@ -0,0 +1,270 @@
+#ifndef __TREE_WRITER_HPP__
+#define __TREE_WRITER_HPP__
+
+#include <vector>
+#include <string>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <pfp/config.h>
+#include <pfp/util.hpp>
+
+namespace com { namespace wavii { namespace pfp {
+
+// writers that serialize a parse tree onto the end of a string the caller keeps and reuses, so
+// once it's grown, writing a tree allocates nothing.  they see the tree as stitch does: the
+// boundary is left out, and a node without children is a tag over the next word.
+// each is a functor, so any of them can be handed to a template that writes trees
+//
+//   bracket_writer  penn treebank brackets, byte for byte as stitch writes them
+//   json_writer     {"label":"NP","begin":0,"score":-12.5,"children":[...],"end":2}, with a "word"
+//                   in place of children at a tag.  scores are log probabilities
+//   binary_writer   a compact preorder encoding, for clients that would rather not parse text:
+//
+//     tree  := varint(label count) label* node
+//     label := varint(length) bytes            each label the tree uses, in order of first use
+//     node  := varint(label) svarint(score) varint(child count) child* | word   word only if no children
+//     word  := varint(length) bytes
+//
+//   varints are little-endian base 128, svarints zigzag-encoded first, and scores are raw
+//   chart scores: consts::score_resolution times the log probability
+
+enum tree_format { bracket_format, json_format, binary_format };
+
+// a format by name: brackets, json, or binary.  returns false if there's no such format
+inline bool format_by_name(const std::string & name, tree_format & format)
+{
+  if (name == "brackets")
+    format = bracket_format;
+  else if (name == "json")
+    format = json_format;
+  else if (name == "binary")
+    format = binary_format;
+  else
+    return false;
+  return true;
+}
+
+inline void append_uint(std::string & out, unsigned long n)
+{
+  char buf[24], * p = buf + sizeof(buf);
+  do { *--p = static_cast< char >('0' + n % 10); n /= 10; } while (n);
+  out.append(p, buf + sizeof(buf));
+}
+
+// a chart score as a log probability, to two decimal places, which is as fine as scores go
+inline void append_score(std::string & out, score_t score)
+{
+  double hundredths = score * 100.0 / consts::score_resolution;
+  unsigned long n = static_cast< unsigned long >((hundredths < 0 ? -hundredths : hundredths) + 0.5);
+  if (hundredths < 0 && n != 0)
+    out += '-';
+  append_uint(out, n / 100);
+  if (n % 100)
+  {
+    out += '.';
+    out += static_cast< char >('0' + n % 100 / 10);
+    if (n % 10)
+      out += static_cast< char >('0' + n % 10);
+  }
+}
+
+inline void append_varint(std::string & out, boost::uint64_t n)
+{
+  for (; n >= 0x80; n >>= 7)
+    out += static_cast< char >((n & 0x7f) | 0x80);
+  out += static_cast< char >(n);
+}
+
+inline void append_svarint(std::string & out, boost::int64_t n)
+{
+  append_varint(out, (static_cast< boost::uint64_t >(n) << 1) ^ static_cast< boost::uint64_t >(n >> 63));
+}
+
+// a node's label as stitch writes it: its basic category, or the word if a tag has none
+template<class StateList>
+const std::string & tree_label(const node & tree, const std::string & word, StateList & states)
+{
+  const std::string & category = states.basic_category(tree.state);
+  return category.empty() && tree.children.empty() ? word : category;
+}
+
+struct bracket_writer
+{
+  template<class StateList>
+  void operator()(std::string & out, const node & tree, const std::vector< std::string > & words, StateList & states) const
+  {
+    pos_t word = 0;
+    write(out, tree, words, word, states);
+  }
+
+private:
+
+  template<class StateList>
+  void write(std::string & out, const node & tree, const std::vector< std::string > & words, pos_t & word, StateList & states) const
+  {
+    if (tree.state == consts::boundary_state)
+      return;
+    out += '(';
+    out += tree_label(tree, words[word], states);
+    out += ' ';
+    if (tree.children.empty())
+      out += words[word++];
+    for (std::vector< boost::shared_ptr< node > >::const_iterator it = tree.children.begin(); it != tree.children.end(); ++it)
+    {
+      write(out, **it, words, word, states);
+      if (it != tree.children.end() - 1)
+        out += ' ';
+    }
+    out += ')';
+  }
+};
+
+struct json_writer
+{
+  template<class StateList>
+  void operator()(std::string & out, const node & tree, const std::vector< std::string > & words, StateList & states) const
+  {
+    write(out, tree, words, 0, states);
+  }
+
+  static void quote(std::string & out, const std::string & s)
+  {
+    static const char hex[] = "0123456789abcdef";
+    out += '"';
+    for (std::string::const_iterator it = s.begin(); it != s.end(); ++it)
+    {
+      unsigned char c = static_cast< unsigned char >(*it);
+      if (c == '"' || c == '\\')
+        out += '\\', out += *it;
+      else if (c < 0x20)
+        out += "\\u00", out += hex[c >> 4], out += hex[c & 0xf];
+      else
+        out += *it;
+    }
+    out += '"';
+  }
+
+private:
+
+  // write a node whose first word is word, and return the position after its last.  the end isn't
+  // known until the children are written, so it goes last
+  template<class StateList>
+  pos_t write(std::string & out, const node & tree, const std::vector< std::string > & words, pos_t word, StateList & states) const
+  {
+    out += "{\"label\":";
+    quote(out, tree_label(tree, words[word], states));
+    out += ",\"begin\":";
+    append_uint(out, word);
+    out += ",\"score\":";
+    append_score(out, tree.score);
+    pos_t end = word;
+    if (tree.children.empty())
+    {
+      out += ",\"word\":";
+      quote(out, words[end++]);
+    }
+    else
+    {
+      out += ",\"children\":[";
+      bool first = true;
+      for (std::vector< boost::shared_ptr< node > >::const_iterator it = tree.children.begin(); it != tree.children.end(); ++it)
+      {
+        if ((*it)->state == consts::boundary_state)
+          continue;
+        if (!first)
+          out += ',';
+        first = false;
+        end = write(out, **it, words, end, states);
+      }
+      out += ']';
+    }
+    out += ",\"end\":";
+    append_uint(out, end);
+    out += '}';
+    return end;
+  }
+};
+
+struct binary_writer
+{
+  template<class StateList>
+  void operator()(std::string & out, const node & tree, const std::vector< std::string > & words, StateList & states) const
+  {
+    // the label table comes first, so gather the labels in preorder
+    std::vector< const std::string * > labels;
+    pos_t word = 0;
+    gather(tree, words, word, labels, states);
+    append_varint(out, labels.size());
+    for (std::vector< const std::string * >::const_iterator it = labels.begin(); it != labels.end(); ++it)
+    {
+      append_varint(out, (*it)->size());
+      out += **it;
+    }
+    word = 0;
+    write(out, tree, words, word, labels, states);
+  }
+
+private:
+
+  static size_t label_index(const std::vector< const std::string * > & labels, const std::string & label)
+  {
+    size_t i = 0;
+    while (i != labels.size() && *labels[i] != label)
+      ++i;
+    return i;
+  }
+
+  template<class StateList>
+  void gather(const node & tree, const std::vector< std::string > & words, pos_t & word,
+              std::vector< const std::string * > & labels, StateList & states) const
+  {
+    if (tree.state == consts::boundary_state)
+      return;
+    const std::string & label = tree_label(tree, words[word], states);
+    if (label_index(labels, label) == labels.size())
+      labels.push_back(&label);
+    if (tree.children.empty())
+      ++word;
+    for (std::vector< boost::shared_ptr< node > >::const_iterator it = tree.children.begin(); it != tree.children.end(); ++it)
+      gather(**it, words, word, labels, states);
+  }
+
+  template<class StateList>
+  void write(std::string & out, const node & tree, const std::vector< std::string > & words, pos_t & word,
+             const std::vector< const std::string * > & labels, StateList & states) const
+  {
+    append_varint(out, label_index(labels, tree_label(tree, words[word], states)));
+    append_svarint(out, tree.score);
+    size_t children = 0;
+    for (std::vector< boost::shared_ptr< node > >::const_iterator it = tree.children.begin(); it != tree.children.end(); ++it)
+      children += (*it)->state != consts::boundary_state;
+    append_varint(out, children);
+    if (tree.children.empty())
+    {
+      append_varint(out, words[word].size());
+      out += words[word++];
+    }
+    for (std::vector< boost::shared_ptr< node > >::const_iterator it = tree.children.begin(); it != tree.children.end(); ++it)
+    {
+      if ((*it)->state != consts::boundary_state)
+        write(out, **it, words, word, labels, states);
+    }
+  }
+};
+
+// write a tree in a format chosen at run time
+template<class StateList>
+void write_tree(tree_format format, std::string & out, const node & tree, const std::vector< std::string > & words, StateList & states)
+{
+  switch (format)
+  {
+  case bracket_format: bracket_writer()(out, tree, words, states); break;
+  case json_format:    json_writer()(out, tree, words, states); break;
+  case binary_format:  binary_writer()(out, tree, words, states); break;
+  }
+}
+
+}}} // com::wavii::pfp
+
+#endif // __TREE_WRITER_HPP__
@@ -4,6 +4,7 @@
 #include <vector>
 #include <limits>
 #include <algorithm>
+#include <boost/cstdint.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include <pfp/config.h>
@@ -34,6 +35,16 @@ struct node
   node(state_t state_, score_t score_) : state(state_), score(score_) {}
 };
 
+// a constituent and the words it covers, [begin, end)
+struct span
+{
+  state_t           state;
+  pos_t             begin;
+  pos_t             end;
+  span() : state(0), begin(0), end(0) {}
+  span(state_t state_, pos_t begin_, pos_t end_) : state(state_), begin(begin_), end(end_) {}
+};
+
 // bounds represent the widest and the narrowest that we've ever seen
 // a state extent right from a start position, or extend left from an
 // end position
@@ -140,6 +151,189 @@ struct workspace
   }
 };
 
+// a workspace for long sentences, that only keeps the scores a parse actually fills.
+// a dense workspace holds a score for every state over every span, and so grows with the square
+// of the sentence length times the number of states: gigabytes for a long sentence, though only a
+// few percent of it is ever scored.  the parser only writes a span while it's working on it, and
+// after that only reads it, so here the open span is written densely, and when the parser moves
+// on it's packed into a bitmap of the states it has and a list of their scores.
+// reads cost a popcount, so dense workspaces are still better for ordinary sentences
+struct sparse_workspace
+{
+  enum { no_slot = 0xffffffff };
+
+  pos_t words;    // the longest sentence this workspace will support
+  state_t states; // the number of states this workspace will support
+
+  std::vector< std::vector< bounds > > left_extents;  // end, state => bounds
+  std::vector< std::vector< bounds > > rite_extents; // begin, state => bounds
+  std::vector< std::vector< state_t > > seen_states; // begin => state (sparse)
+
+  size_t blocks;                          // 64-bit words of bitmap per span
+  std::vector< boost::uint32_t > slots;   // span => where its bitmap is packed, in blocks
+  std::vector< boost::uint64_t > bitmaps; // slot, block => which states a span has
+  std::vector< boost::uint16_t > ranks;   // slot, block => states in the span's earlier blocks
+  std::vector< boost::uint32_t > offsets; // slot => where its scores begin
+  std::vector< score_t > scores;          // scores of packed spans, by span then state
+
+  pos_t open_begin, open_end;             // the span being written, if any
+  std::vector< score_t > open_scores;     // its scores, densely
+  std::vector< state_t > open_states;     // the states it has
+
+  sparse_workspace(pos_t words_, state_t states_)
+  : words(words_), states(states_),
+  left_extents(words + 1), rite_extents(words),
+  seen_states(words), blocks((states + 63) / 64),
+  open_begin(0), open_end(0), open_scores(states, consts::empty_score)
+  {
+    for (pos_t i = 0; i != words + 1; ++i)
+      left_extents[i].resize(states);
+    for (pos_t i = 0; i != words; ++i)
+      rite_extents[i].resize(states);
+    for (pos_t i = 0; i != words; ++i)
+      seen_states[i].reserve(1024);
+    slots.resize(span(0, words + 1), static_cast<boost::uint32_t>(no_slot));
+  }
+
+  // spans are numbered by end, then begin: the upper triangle, packed
+  static size_t span(pos_t begin, pos_t end)
+  {
+    return static_cast<size_t>(end) * (end - 1) / 2 + begin;
+  }
+
+  void clear()
+  {
+    clear(words);
+  }
+
+  void clear(pos_t sentence_size)
+  {
+    for (pos_t i = 0; i != sentence_size + 1; ++i)
+      std::fill(left_extents[i].begin(), left_extents[i].end(), bounds(std::numeric_limits<pos_t>::min(), std::numeric_limits<pos_t>::max()));
+    for (pos_t i = 0; i != sentence_size; ++i)
+      std::fill(rite_extents[i].begin(), rite_extents[i].end(), bounds(std::numeric_limits<pos_t>::max(), std::numeric_limits<pos_t>::min()));
+    for (pos_t i = 0; i != sentence_size; ++i)
+      seen_states[i].clear();
+    std::fill(slots.begin(), slots.begin() + span(0, sentence_size + 1), static_cast<boost::uint32_t>(no_slot));
+    bitmaps.clear();
+    ranks.clear();
+    offsets.clear();
+    scores.clear();
+    for (std::vector< state_t >::const_iterator it = open_states.begin(); it != open_states.end(); ++it)
+      open_scores[*it] = consts::empty_score;
+    open_states.clear();
+    open_begin = open_end = 0;
+  }
+
+  // pack the open span away
+  void close()
+  {
+    if (open_end == 0)
+      return;
+    std::sort(open_states.begin(), open_states.end());
+    slots[span(open_begin, open_end)] = static_cast<boost::uint32_t>(offsets.size());
+    offsets.push_back(static_cast<boost::uint32_t>(scores.size()));
+    size_t first = bitmaps.size();
+    bitmaps.resize(first + blocks, 0);
+    ranks.resize(first + blocks, 0);
+    for (std::vector< state_t >::const_iterator it = open_states.begin(); it != open_states.end(); ++it)
+    {
+      bitmaps[first + *it / 64] |= boost::uint64_t(1) << (*it % 64);
+      scores.push_back(open_scores[*it]);
+      open_scores[*it] = consts::empty_score;
+    }
+    for (size_t i = 1, rank = 0; i != blocks; ++i)
+      ranks[first + i] = static_cast<boost::uint16_t>(rank += popcount(bitmaps[first + i - 1]));
+    open_states.clear();
+    open_end = 0;
+  }
+
+  // make [begin, end) the open span, unpacking it if we've been there before
+  void open(pos_t begin, pos_t end)
+  {
+    close();
+    open_begin = begin;
+    open_end = end;
+    boost::uint32_t slot = slots[span(begin, end)];
+    if (slot == no_slot)
+      return;
+    // its old packing is left where it is, unused
+    slots[span(begin, end)] = static_cast<boost::uint32_t>(no_slot);
+    const score_t * ps = &scores[offsets[slot]];
+    for (size_t i = 0; i != blocks; ++i)
+    {
+      for (boost::uint64_t bits = bitmaps[slot * blocks + i]; bits; bits &= bits - 1)
+      {
+        state_t state = static_cast<state_t>(i * 64 + __builtin_ctzll(bits));
+        open_scores[state] = *ps++;
+        open_states.push_back(state);
+      }
+    }
+  }
+
+  static unsigned popcount(boost::uint64_t bits)
+  {
+    return __builtin_popcountll(bits);
+  }
+
+  void put(pos_t begin, pos_t end, state_t state, score_t score)
+  {
+    if (begin != open_begin || end != open_end)
+      open(begin, end);
+    score_t & f = open_scores[state];
+    if (f == consts::empty_score)
+    {
+      f = score;
+      open_states.push_back(state);
+      // as for workspace::put
+      bounds & bl = left_extents[end][state];
+      bounds & br = rite_extents[begin][state];
+      if (begin > bl.narrow)
+        bl.narrow = bl.wide = begin;
+      else if (begin < bl.wide)
+        bl.wide = begin;
+      if (end < br.narrow)
+      {
+        br.narrow = br.wide = end;
+        seen_states[begin].push_back(state);
+      }
+      else if (end > br.wide)
+        br.wide = end;
+    }
+    else if (f < score)
+      f = score;
+  }
+
+  template<class InputIterator>
+  void put(pos_t begin, pos_t end, InputIterator ss_begin, InputIterator ss_end)
+  {
+    for (; ss_begin != ss_end; ++ss_begin)
+      put(begin, end, ss_begin->state, ss_begin->score);
+  }
+
+  score_t get(pos_t begin, pos_t end, state_t state)
+  {
+    if (begin == open_begin && end == open_end)
+      return open_scores[state];
+    boost::uint32_t slot = slots[span(begin, end)];
+    if (slot == no_slot)
+      return consts::empty_score;
+    size_t block = slot * blocks + state / 64;
+    boost::uint64_t bits = bitmaps[block], bit = boost::uint64_t(1) << (state % 64);
+    if (!(bits & bit))
+      return consts::empty_score;
+    return scores[offsets[slot] + ranks[block] + popcount(bits & (bit - 1))];
+  }
+
+  // roughly how much memory the scores take up now
+  size_t bytes() const
+  {
+    return slots.capacity() * sizeof(boost::uint32_t) + bitmaps.capacity() * sizeof(boost::uint64_t)
+         + ranks.capacity() * sizeof(boost::uint16_t) + offsets.capacity() * sizeof(boost::uint32_t)
+         + (scores.capacity() + open_scores.capacity()) * sizeof(score_t) + open_states.capacity() * sizeof(state_t);
+  }
+};
+
 // stich a node tree to a an output
 template<class Out, class InputIterator, class StateList>
 InputIterator stitch(Out & out, const node & tree, InputIterator word_it, StateList & states)
@@ -149,10 +343,10 @@ InputIterator stitch(Out & out, const node & tree, InputIterator word_it, StateL
     return word_it;
 
   out << '(';
-  if (states[tree.state].basic_category().empty() && tree.children.empty())
+  if (states.basic_category(tree.state).empty() && tree.children.empty())
       out << *word_it;
   else
-      out << states[tree.state].basic_category();
+      out << states.basic_category(tree.state);
   out << ' ';
 
   if ( tree.children.empty() ) {
@@ -171,6 +365,54 @@ InputIterator stitch(Out & out, const node & tree, InputIterator word_it, StateL
   return word_it;
 }
 
+// collect the spans of the nodes of a tree whose states are marked in wanted, outermost
+// first, and return where the tree ends.  the tree's first word is at begin
+inline pos_t tree_spans(const node & tree, const std::vector< bool > & wanted, std::vector< span > & spans, pos_t begin = 0)
+{
+  if (tree.state == consts::boundary_state)
+    return begin;
+  if (tree.children.empty())
+  {
+    if (wanted[tree.state])
+      spans.push_back(span(tree.state, begin, static_cast< pos_t >(begin + 1)));
+    return static_cast< pos_t >(begin + 1);
+  }
+  size_t i = spans.size();
+  if (wanted[tree.state])
+    spans.push_back(span(tree.state, begin, begin));
+  pos_t end = begin;
+  for (std::vector< boost::shared_ptr< node > >::const_iterator it = tree.children.begin(); it != tree.children.end(); ++it)
+    end = tree_spans(**it, wanted, spans, end);
+  if (wanted[tree.state])
+    spans[i].end = end;
+  return end;
+}
+
+// write spans to an output as (LABEL begin end), space separated
+template<class Out, class StateList>
+void stitch_spans(Out & out, const std::vector< span > & spans, StateList & states)
+{
+  for (std::vector< span >::const_iterator it = spans.begin(); it != spans.end(); ++it)
+  {
+    if (it != spans.begin())
+      out << ' ';
+    out << '(' << states.basic_category(it->state) << ' ' << static_cast< int >(it->begin) << ' ' << static_cast< int >(it->end) << ')';
+  }
+}
+
+// write tagged words to an output as word/TAG, space separated
+template<class Out, class InputIterator, class StateList>
+void stitch_tags(Out & out, InputIterator word_it, InputIterator word_end, const std::vector< state_t > & tags, StateList & states)
+{
+  for (std::vector< state_t >::const_iterator it = tags.begin(); it != tags.end() && word_it != word_end; ++it, ++word_it)
+  {
+    if (it != tags.begin())
+      out << ' ';
+    const std::string & category = states.basic_category(*it);
+    out << *word_it << '/' << (category.empty() ? states[*it].tag : category);
+  }
+}
+
 }}} // com::wavii::pfp
 
 #endif // __UTIL_HPP__
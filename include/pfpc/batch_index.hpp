@@ -0,0 +1,48 @@
+#ifndef __BATCH_INDEX_HPP__
+#define __BATCH_INDEX_HPP__
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <stdexcept>
+#include <boost/cstdint.hpp>
+
+namespace com { namespace wavii { namespace pfp {
+
+// pfp_batch's index, <output>.idx, which is also its checkpoint:
+//
+//   pfp_batch <input bytes> <format>              the first line, saying what the output is of
+//   <input end> <output end> <sentences>          one line per chunk written, each a running total
+
+// read the checkpoint in an index: how far into the input the written chunks go, how much output they
+// wrote, how many sentences they held, and how much of the index lists them.  throws if the index is
+// of some other input or format
+inline void read_checkpoint(const std::string & index_path, boost::uintmax_t input_size, const std::string & format_name,
+                            boost::uintmax_t & input_end, boost::uintmax_t & output_end, boost::uintmax_t & sentences,
+                            boost::uintmax_t & index_end)
+{
+  std::ifstream in(index_path.c_str(), std::ios::binary);
+  std::string line, magic, format;
+  boost::uintmax_t size = 0;
+  if (!std::getline(in, line) || in.eof())
+    throw std::runtime_error(index_path + " has no header: remove it to start over");
+  std::istringstream header(line);
+  if (!(header >> magic >> size >> format) || magic != "pfp_batch")
+    throw std::runtime_error(index_path + " isn't a pfp_batch index: remove it to start over");
+  if (size != input_size || format != format_name)
+    throw std::runtime_error(index_path + " is of another input or format: remove it to start over");
+  input_end = output_end = sentences = 0;
+  index_end = line.size() + 1;
+  // a line the last run didn't finish writing has no newline, and doesn't count
+  while (std::getline(in, line) && !in.eof())
+  {
+    std::istringstream entry(line);
+    if (!(entry >> input_end >> output_end >> sentences))
+      throw std::runtime_error(index_path + " is corrupt: remove it to start over");
+    index_end += line.size() + 1;
+  }
+}
+
+}}} // com::wavii::pfp
+
+#endif // __BATCH_INDEX_HPP__
@@ -0,0 +1,79 @@
+#ifndef __CHUNK_DEQUES_HPP__
+#define __CHUNK_DEQUES_HPP__
+
+#include <deque>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace com { namespace wavii { namespace pfp {
+
+// numbered chunks of work, dealt round robin into a deque for each worker.  a worker takes from the
+// front of its own deque, and once that's empty, steals from whichever deque holds the earliest
+// chunk.  workers mostly keep to their own deques, so they rarely contend, and between dealing
+// and stealing the chunks finish in about the order they're numbered, which keeps the buffer of
+// results waiting to be written in order small
+class chunk_deques : private boost::noncopyable
+{
+private:
+
+  struct worker_deque
+  {
+    boost::mutex         mutex;
+    std::deque< size_t > chunks;
+  };
+
+  std::vector< boost::shared_ptr< worker_deque > > deques_;
+
+public:
+
+  // deal chunks [begin, end) out to workers deques
+  chunk_deques(size_t workers, size_t begin, size_t end)
+  {
+    for (size_t i = 0; i != workers; ++i)
+      deques_.push_back(boost::shared_ptr< worker_deque >(new worker_deque));
+    for (size_t chunk = begin; chunk != end; ++chunk)
+      deques_[(chunk - begin) % workers]->chunks.push_back(chunk);
+  }
+
+  // the next chunk for a worker: its own, or else one stolen.  returns false once there are none left
+  bool take(size_t worker, size_t & chunk)
+  {
+    {
+      worker_deque & own = *deques_[worker];
+      boost::mutex::scoped_lock lock(own.mutex);
+      if (!own.chunks.empty())
+      {
+        chunk = own.chunks.front();
+        own.chunks.pop_front();
+        return true;
+      }
+    }
+    // steal the earliest chunk, which is the one the writer will want soonest.  it may be gone
+    // by the time we lock its deque, so look again until every deque is empty
+    for (;;)
+    {
+      size_t victim = deques_.size(), earliest = 0;
+      for (size_t i = 0; i != deques_.size(); ++i)
+      {
+        boost::mutex::scoped_lock lock(deques_[i]->mutex);
+        if (!deques_[i]->chunks.empty() && (victim == deques_.size() || deques_[i]->chunks.front() < earliest))
+          victim = i, earliest = deques_[i]->chunks.front();
+      }
+      if (victim == deques_.size())
+        return false;
+      boost::mutex::scoped_lock lock(deques_[victim]->mutex);
+      if (!deques_[victim]->chunks.empty())
+      {
+        chunk = deques_[victim]->chunks.front();
+        deques_[victim]->chunks.pop_front();
+        return true;
+      }
+    }
+  }
+};
+
+}}} // com::wavii::pfp
+
+#endif // __CHUNK_DEQUES_HPP__
@@ -0,0 +1,89 @@
+#ifndef __ORDERED_BATCH_HPP__
+#define __ORDERED_BATCH_HPP__
+
+#include <deque>
+#include <utility>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+
+#include <pfpc/reorder_buffer.hpp>
+
+namespace com { namespace wavii { namespace pfp {
+
+// hands numbered inputs from one reader to many workers, and their results back to one
+// writer in the order the inputs were read, through a reorder_buffer.  the reader can get
+// at most window inputs ahead of the writer, so a slow input holds back memory, not just output
+template<class In, class Out>
+class ordered_batch : private boost::noncopyable
+{
+private:
+
+  boost::mutex                          mutex_;
+  boost::condition                      cond_;
+  std::deque< std::pair< size_t, In > > input_;   // read, and not yet taken by a worker
+  size_t                                read_;    // inputs read so far.  only the reader changes it
+  bool                                  closed_;  // the reader's done
+  reorder_buffer< Out >                 results_;
+
+public:
+
+  ordered_batch(size_t window) : read_(0), closed_(false), results_(window) {}
+
+  // queue the next input, waiting while the reader is too far ahead.  in is swapped out, and left empty
+  void push(In & in)
+  {
+    results_.wait_room(read_);
+    boost::mutex::scoped_lock lock(mutex_);
+    input_.push_back(std::make_pair(read_++, In()));
+    std::swap(input_.back().second, in);
+    cond_.notify_all();
+  }
+
+  // no more inputs are coming
+  void close()
+  {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      closed_ = true;
+      cond_.notify_all();
+    }
+    results_.close(read_);
+  }
+
+  // take the next input to work on, waiting for one.  returns false once they're all taken
+  bool pop(size_t & seq, In & in)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (input_.empty() && !closed_)
+      cond_.wait(lock);
+    if (input_.empty())
+      return false;
+    seq = input_.front().first;
+    std::swap(input_.front().second, in);
+    input_.pop_front();
+    return true;
+  }
+
+  // hand back the result of input seq.  out is swapped out
+  void finish(size_t seq, Out & out)
+  {
+    results_.finish(seq, out);
+  }
+
+  // take the next result in order if it's finished, without waiting.  returns false if it isn't
+  bool try_next(Out & out)
+  {
+    return results_.try_next(out);
+  }
+
+  // take the next result in order, waiting for it.  returns false once every input's been written
+  bool next(Out & out)
+  {
+    return results_.next(out);
+  }
+};
+
+}}} // com::wavii::pfp
+
+#endif // __ORDERED_BATCH_HPP__
@@ -0,0 +1,96 @@
+#ifndef __REORDER_BUFFER_HPP__
+#define __REORDER_BUFFER_HPP__
+
+#include <map>
+#include <limits>
+#include <algorithm>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+
+namespace com { namespace wavii { namespace pfp {
+
+// results numbered from 0, handed back by many workers in any order and taken by one writer in
+// number order.  results that finish early wait here until those before them are written.  work on
+// a result more than window ahead of the writer waits to start, so a slow one holds back memory,
+// not just output
+template<class Out>
+class reorder_buffer : private boost::noncopyable
+{
+private:
+
+  boost::mutex              mutex_;
+  boost::condition          cond_;
+  std::map< size_t, Out >   done_;     // finished, and not yet written
+  size_t                    written_;  // results written so far
+  size_t                    end_;      // how many results there are, once we know
+  size_t                    window_;
+
+public:
+
+  reorder_buffer(size_t window) : written_(0), end_(std::numeric_limits< size_t >::max()), window_(window) {}
+
+  // wait until the writer's close enough to seq to start on it
+  void wait_room(size_t seq)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (seq >= written_ + window_)
+      cond_.wait(lock);
+  }
+
+  // there are end results in all
+  void close(size_t end)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    end_ = end;
+    cond_.notify_all();
+  }
+
+  // hand back result seq.  out is swapped out
+  void finish(size_t seq, Out & out)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    std::swap(done_[seq], out);
+    if (seq == written_)
+      cond_.notify_all();
+  }
+
+  // take the next result in order if it's finished, without waiting.  returns false if it isn't
+  bool try_next(Out & out)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    return take(out);
+  }
+
+  // take the next result in order, waiting for it.  returns false once every result's been written
+  bool next(Out & out)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (!take(out))
+    {
+      if (written_ == end_)
+        return false;
+      cond_.wait(lock);
+    }
+    return true;
+  }
+
+private:
+
+  bool take(Out & out)
+  {
+    typename std::map< size_t, Out >::iterator it = done_.find(written_);
+    if (it == done_.end())
+      return false;
+    std::swap(out, it->second);
+    done_.erase(it);
+    ++written_;
+    // room for the workers
+    cond_.notify_all();
+    return true;
+  }
+};
+
+}}} // com::wavii::pfp
+
+#endif // __REORDER_BUFFER_HPP__
@@ -0,0 +1,232 @@
+#ifndef __SENTENCE_PARSER_HPP__
+#define __SENTENCE_PARSER_HPP__
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+#include <boost/lexical_cast.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/filesystem/operations.hpp>
+
+#include <pfp/config.h>
+#include <pfp/tokenizer.h>
+#include <pfp/state_list.hpp>
+#include <pfp/lexicon.hpp>
+#include <pfp/unary_grammar.hpp>
+#include <pfp/binary_grammar.hpp>
+#include <pfp/pcfg_parser.hpp>
+#include <pfp/sentence_splitter.hpp>
+#include <pfp/tagger.hpp>
+#include <pfp/tree_writer.hpp>
+
+namespace com { namespace wavii { namespace pfp {
+
+template<class T>
+void load(T & obj, boost::filesystem::path p)
+{
+  if (!boost::filesystem::exists(p))
+    throw std::runtime_error("can't find " + p.string());
+  std::ifstream in(p.string().c_str());
+  obj.load(in);
+}
+
+// load the tokenizer, lexicon, and grammar from data_dir
+inline void load_model(const std::string & data_dir, tokenizer & tokenizer, state_list & states, lexicon & lexicon,
+                       unary_grammar & ug, binary_grammar & bg)
+{
+  namespace fs = boost::filesystem;
+  load(tokenizer, fs::path(data_dir) / "americanizations");
+  load(states, fs::path(data_dir) / "states");
+  {
+    fs::path ps[] = { fs::path(data_dir) / "words", fs::path(data_dir) / "sigs", fs::path(data_dir) / "word_state", fs::path(data_dir) / "sig_state" };
+    std::ifstream ins[4];
+    for (int i = 0; i != 4; ++i)
+    {
+      if (!fs::exists(ps[i]))
+        throw std::runtime_error("can't find " + ps[i].string());
+      ins[i].open(ps[i].string().c_str());
+    }
+    lexicon.load(ins[0], ins[1], ins[2], ins[3]);
+  }
+  load(ug, fs::path(data_dir) / "unary_rules");
+  load(bg, fs::path(data_dir) / "binary_rules");
+}
+
+// parse in a workspace, counting work into stats if it isn't null.  if there's no parse, or the deadline
+// passes, read back the best fragments in the chart instead, and return false
+template<class Workspace>
+bool parse(pcfg_parser & pcfg, const std::vector< std::vector< state_score_t > > & sentence_f, Workspace & ws, node & result,
+           const boost::posix_time::ptime & deadline, parse_stats * stats)
+{
+  bool found = false;
+  try
+  {
+    found = stats ? pcfg.fill(sentence_f, ws, deadline, *stats) : pcfg.fill(sentence_f, ws, deadline);
+    if (!found)
+      std::clog << "no parse: falling back to fragments" << std::endl;
+  }
+  catch (const parse_timeout &)
+  {
+    std::clog << "timed out: falling back to fragments" << std::endl;
+  }
+  if (found && stats)
+    pcfg.backtrace(sentence_f, ws, result, *stats);
+  else if (found)
+    pcfg.backtrace(sentence_f, ws, result);
+  else if (stats)
+    pcfg.fragments(sentence_f, ws, result, *stats);
+  else
+    pcfg.fragments(sentence_f, ws, result);
+  return found;
+}
+
+// parse in w if the sentence fits, or else in a sparse workspace of its own, which only keeps the scores it fills
+inline bool parse_sized(pcfg_parser & pcfg, const std::vector< std::vector< state_score_t > > & sentence_f, workspace & w,
+                        node & result, const boost::posix_time::ptime & deadline, parse_stats * stats)
+{
+  if (sentence_f.size() <= w.words)
+    return parse(pcfg, sentence_f, w, result, deadline, stats);
+  if (sentence_f.size() > consts::max_sentence_size)
+    throw std::runtime_error("sentence too large to parse (" + boost::lexical_cast<std::string>(sentence_f.size()) + ">"
+                             + boost::lexical_cast<std::string>(consts::max_sentence_size) + ")");
+  sparse_workspace pw(static_cast<pos_t>(sentence_f.size()), w.states);
+  return parse(pcfg, sentence_f, pw, result, deadline, stats);
+}
+
+// what came of one sentence, waiting its turn to be written
+struct sentence_result
+{
+  std::string out;     // the parse or tags, as they'll be written
+  bool        failed;  // nothing to write but an empty result
+  size_t      words;
+  parse_stats stats;
+
+  sentence_result() : failed(false), words(0) {}
+};
+
+// parses or tags one sentence at a time.  nothing in it changes once it's loaded, so threads can
+// share one, as long as each brings a workspace of its own
+class sentence_parser
+{
+private:
+
+  const state_list &                states_;
+  lexicon &                         lexicon_;
+  pcfg_parser &                     pcfg_;
+  const sentence_splitter &         splitter_;
+  tagger &                          tagger_;
+  bool                              split_, tag_, stats_;
+  boost::posix_time::time_duration  timeout_;
+  tree_format                       format_;
+
+public:
+
+  sentence_parser(const state_list & states, lexicon & lexicon, pcfg_parser & pcfg, const sentence_splitter & splitter,
+                  tagger & tagger, bool split, bool tag, bool stats, boost::posix_time::time_duration timeout, tree_format format)
+  : states_(states), lexicon_(lexicon), pcfg_(pcfg), splitter_(splitter), tagger_(tagger),
+    split_(split), tag_(tag), stats_(stats), timeout_(timeout), format_(format)
+  {
+  }
+
+  bool tagging() const { return tag_; }
+
+  // parse or tag words in w.  result's out is reused, so it only grows a few times
+  void operator()(const std::vector< std::string > & words, workspace & w, sentence_result & result) const
+  {
+    result.out.clear();
+    result.failed = false;
+    result.words = words.size();
+    result.stats.clear();
+    if (tag_)
+    {
+      std::vector< state_t > tags;
+      std::ostringstream oss;
+      try
+      {
+        tagger_.tag(words, tags);
+        stitch_tags(oss, words.begin(), words.end(), tags, states_);
+      }
+      catch (const std::runtime_error & e)
+      {
+        std::clog << "error: " << e.what() << std::endl;
+      }
+      result.out = oss.str();
+      return;
+    }
+    std::vector< std::vector< state_score_t > > sentence_f;
+    node tree;
+    for (std::vector< std::string >::const_iterator it = words.begin(); it != words.end(); ++it)
+    {
+      sentence_f.push_back(std::vector< state_score_t >());
+      lexicon_.chart_score(*it, std::back_inserter(sentence_f.back()));
+    }
+    // add the boundary symbol
+    sentence_f.push_back( std::vector< state_score_t >(1, state_score_t(consts::boundary_state, 0.0f)));
+    // and parse!
+    try
+    {
+      boost::posix_time::ptime deadline = boost::posix_time::microsec_clock::universal_time() + timeout_;
+      std::vector< size_t > ends;
+      if (split_ && splitter_.split(words, ends))
+      {
+        // parse each piece as a sentence of its own, then join them back up
+        std::vector< node > segments(ends.size());
+        for (size_t i = 0, begin = 0; i != ends.size(); begin = ends[i++])
+        {
+          std::vector< std::vector< state_score_t > > segment_f(sentence_f.begin() + begin, sentence_f.begin() + ends[i]);
+          segment_f.push_back(sentence_f.back());
+          parse_sized(pcfg_, segment_f, w, segments[i], deadline, stats_ ? &result.stats : 0);
+        }
+        splitter_.join(segments, tree);
+      }
+      else
+        parse_sized(pcfg_, sentence_f, w, tree, deadline, stats_ ? &result.stats : 0);
+    }
+    catch (const std::runtime_error & e)
+    {
+      // such as a sentence too long to parse at all
+      std::clog << "error: " << e.what() << std::endl;
+      result.failed = true;
+      return;
+    }
+    // stitch together the results
+    write_tree(format_, result.out, tree, words, states_);
+  }
+
+  // add a result to out as it's written: a line of tags, brackets, or json, with null for json that
+  // failed, or binary prefixed by its length
+  void append(std::string & out, const sentence_result & result) const
+  {
+    if (tag_)
+    {
+      out += result.out;
+      out += '\n';
+      return;
+    }
+    const std::string & tree = result.failed ? empty() : result.out;
+    if (format_ == binary_format)
+      append_varint(out, tree.size());
+    if (tree.empty() && format_ == json_format)
+      out += "null";
+    else
+      out += tree;
+    if (format_ != binary_format)
+      out += '\n';
+  }
+
+private:
+
+  static const std::string & empty()
+  {
+    static const std::string s;
+    return s;
+  }
+};
+
+}}} // com::wavii::pfp
+
+#endif // __SENTENCE_PARSER_HPP__
@@ -0,0 +1,198 @@
+#ifndef __JOB_QUEUE_HPP__
+#define __JOB_QUEUE_HPP__
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+
+namespace com { namespace wavii { namespace pfp {
+
+// a pool of worker threads fed by a bounded queue of jobs.  push never blocks:
+// when the queue is full it refuses the job, so the caller can shed load.
+// jobs are run shortest first by their estimated cost, aged by how long they've
+// waited: a job runs once its arrival time plus its cost comes up, so a cheap
+// job can overtake an expensive one, but only by about the expensive one's cost
+class job_queue : private boost::noncopyable
+{
+public:
+
+  typedef boost::function< void () > job_t;
+
+private:
+
+  struct entry
+  {
+    double   key;     // arrival + cost: lower runs first
+    size_t   seq;     // first come first served among equal keys
+    job_t    job;
+    // for a min-heap
+    bool operator<(const entry & rhs) const
+    {
+      return key > rhs.key || (key == rhs.key && seq > rhs.seq);
+    }
+  };
+
+  // items of a for_each, and the threads working through them.  helpers that are still queued when
+  // the caller's done hold on to it, and find nothing left to do
+  struct spread
+  {
+    boost::function< bool (size_t) >  fn;
+    size_t                            n;
+    size_t                            next;
+    size_t                            running;  // items being worked on
+    bool                              stopped;
+    std::string                       error;    // what the first item to throw threw
+    boost::mutex                      mutex;
+    boost::condition                  cond;
+
+    spread(const boost::function< bool (size_t) > & fn, size_t n) : fn(fn), n(n), next(0), running(0), stopped(false) {}
+  };
+
+  // take items of s until there are none left, or one stops the rest
+  static void help(boost::shared_ptr< spread > s)
+  {
+    for (;;)
+    {
+      size_t i;
+      {
+        boost::mutex::scoped_lock lock(s->mutex);
+        if (s->stopped || s->next == s->n)
+          return;
+        i = s->next++;
+        ++s->running;
+      }
+      bool more = false;
+      try { more = s->fn(i); }
+      catch (const std::exception & e)
+      {
+        boost::mutex::scoped_lock lock(s->mutex);
+        if (s->error.empty())
+          s->error = e.what();
+      }
+      boost::mutex::scoped_lock lock(s->mutex);
+      --s->running;
+      s->stopped = s->stopped || !more;
+      s->cond.notify_all();
+    }
+  }
+
+  std::vector< entry >      jobs_;   // a heap
+  size_t                    max_jobs_;
+  double                    aging_;  // cost units a job makes up for each microsecond it waits
+  size_t                    seq_;
+  bool                      stopping_;
+  boost::posix_time::ptime  start_;
+  boost::mutex              mutex_;
+  boost::condition          cond_;
+  boost::thread_group       threads_;
+
+  void work()
+  {
+    for (;;)
+    {
+      job_t job;
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        while (jobs_.empty() && !stopping_)
+          cond_.wait(lock);
+        if (jobs_.empty())
+          return;
+        std::pop_heap(jobs_.begin(), jobs_.end());
+        job.swap(jobs_.back().job);
+        jobs_.pop_back();
+      }
+      // a job that throws shouldn't take its worker down with it
+      try { job(); }
+      catch (const std::exception & e) { std::cerr << "error: " << e.what() << std::endl; }
+    }
+  }
+
+public:
+
+  job_queue()
+  : max_jobs_(0), aging_(1.0), seq_(0), stopping_(false),
+    start_(boost::posix_time::microsec_clock::universal_time())
+  {
+  }
+
+  ~job_queue()
+  {
+    stop();
+  }
+
+  // start threads workers, accepting up to max_jobs waiting jobs.  aging is how many units
+  // of cost a waiting job makes up per microsecond: higher means closer to first come first served
+  void start(size_t threads, size_t max_jobs, double aging = 1.0)
+  {
+    max_jobs_ = max_jobs;
+    aging_ = aging;
+    jobs_.reserve(max_jobs);
+    while (threads-- != 0)
+      threads_.create_thread(boost::bind(&job_queue::work, this));
+  }
+
+  // queue a job with an estimated cost.  returns false, dropping the job, if the queue is full
+  bool push(const job_t & job, double cost = 0.0)
+  {
+    double now = (boost::posix_time::microsec_clock::universal_time() - start_).total_microseconds();
+    boost::mutex::scoped_lock lock(mutex_);
+    if (stopping_ || jobs_.size() >= max_jobs_)
+      return false;
+    jobs_.push_back(entry());
+    jobs_.back().key = now * aging_ + cost;
+    jobs_.back().seq = seq_++;
+    jobs_.back().job = job;
+    std::push_heap(jobs_.begin(), jobs_.end());
+    cond_.notify_one();
+    return true;
+  }
+
+  // call fn on each of the items [0, n), until fn returns false, on up to threads threads: this one,
+  // and helpers queued for the workers.  helpers are queued ahead of most other jobs: they're work for
+  // a job that's already running.  this thread takes items too, and only waits on the helpers that got
+  // to run before the items ran out, so it never waits on the queue, and does everything itself if the
+  // queue's full.  throws std::runtime_error if fn threw
+  void for_each(size_t n, const boost::function< bool (size_t) > & fn, size_t threads)
+  {
+    boost::shared_ptr< spread > s(new spread(fn, n));
+    for (size_t i = 1; i < std::min(threads, n) && push(boost::bind(&job_queue::help, s)); ++i);
+    help(s);
+    boost::mutex::scoped_lock lock(s->mutex);
+    while (s->running != 0)
+      s->cond.wait(lock);
+    if (!s->error.empty())
+      throw std::runtime_error(s->error);
+  }
+
+  // finish the queued jobs, then stop the workers
+  void stop()
+  {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      stopping_ = true;
+      cond_.notify_all();
+    }
+    threads_.join_all();
+  }
+
+  // jobs waiting for a worker
+  size_t size()
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    return jobs_.size();
+  }
+};
+
+}}} // com::wavii::pfp
+
+#endif // __JOB_QUEUE_HPP__
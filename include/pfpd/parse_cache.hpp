@@ -0,0 +1,190 @@
+#ifndef __PARSE_CACHE_HPP__
+#define __PARSE_CACHE_HPP__
+
+#include <list>
+#include <vector>
+#include <string>
+#include <ostream>
+#include <utility>
+#include <algorithm>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace com { namespace wavii { namespace pfp {
+
+// a memory-bounded cache of parses, keyed by the sentence's tokens.
+// split into shards that each keep their own lru list under their own lock,
+// so threads looking up different sentences rarely contend.
+// whatever loads the model must clear it, or it'll hand out stale parses
+class parse_cache : private boost::noncopyable
+{
+private:
+
+  // what an entry costs us beyond its strings: list and map nodes, hash bucket, bookkeeping
+  static const size_t overhead = 96;
+
+  typedef std::list< std::pair< std::string, std::string > >                 lru_t;    // key, parse.  most recent first
+  typedef boost::unordered_map< std::string, lru_t::iterator >               index_t;
+
+  struct shard
+  {
+    boost::mutex     mutex;
+    lru_t            lru;
+    index_t          index;
+    size_t           bytes;
+    boost::uint64_t  hits;
+    boost::uint64_t  misses;
+    boost::uint64_t  inserts;
+    boost::uint64_t  evictions;
+
+    shard() : bytes(0), hits(0), misses(0), inserts(0), evictions(0) {}
+  };
+
+  std::vector< shard * >  shards_;
+  size_t                  shard_bytes_; // the most each shard may hold
+
+  static size_t cost(const std::string & key, const std::string & value)
+  {
+    // the key is held twice: once in the lru list, once in the index
+    return 2 * key.size() + value.size() + overhead;
+  }
+
+  shard & shard_of(const std::string & key)
+  {
+    return *shards_[boost::hash< std::string >()(key) % shards_.size()];
+  }
+
+public:
+
+  parse_cache(size_t num_shards = 16) : shard_bytes_(0)
+  {
+    for (size_t i = 0; i != std::max< size_t >(num_shards, 1); ++i)
+      shards_.push_back(new shard);
+  }
+
+  ~parse_cache()
+  {
+    for (std::vector< shard * >::iterator it = shards_.begin(); it != shards_.end(); ++it)
+      delete *it;
+  }
+
+  // hold up to about max_bytes of parses.  zero turns the cache off
+  void init(size_t max_bytes)
+  {
+    shard_bytes_ = max_bytes / shards_.size();
+    clear();
+  }
+
+  bool enabled() const { return shard_bytes_ != 0; }
+
+  // build a key from a sentence's tokens.  tokens are length-prefixed, so no two sentences share one
+  template<class InputIterator>
+  static std::string key(InputIterator begin, InputIterator end)
+  {
+    std::string k;
+    for (; begin != end; ++begin)
+      k.append(boost::lexical_cast< std::string >(begin->size())).append(1, ':').append(*begin);
+    return k;
+  }
+
+  // look up a parse.  returns false if we don't have it.  a second look for a key that's just
+  // missed isn't a lookup of its own, so it can leave the counters alone
+  bool get(const std::string & key, std::string & value, bool counted = true)
+  {
+    if (!enabled())
+      return false;
+    shard & s = shard_of(key);
+    boost::mutex::scoped_lock lock(s.mutex);
+    index_t::iterator it = s.index.find(key);
+    if (it == s.index.end())
+    {
+      s.misses += counted;
+      return false;
+    }
+    s.hits += counted;
+    s.lru.splice(s.lru.begin(), s.lru, it->second);
+    value = it->second->second;
+    return true;
+  }
+
+  // remember a parse, making room by dropping the least recently used
+  void put(const std::string & key, const std::string & value)
+  {
+    size_t c = cost(key, value);
+    if (!enabled() || c > shard_bytes_)
+      return;
+    shard & s = shard_of(key);
+    boost::mutex::scoped_lock lock(s.mutex);
+    index_t::iterator it = s.index.find(key);
+    if (it != s.index.end())
+    {
+      // someone else parsed it too: just freshen it
+      s.lru.splice(s.lru.begin(), s.lru, it->second);
+      return;
+    }
+    while (s.bytes + c > shard_bytes_)
+    {
+      const lru_t::value_type & victim = s.lru.back();
+      s.bytes -= cost(victim.first, victim.second);
+      s.index.erase(victim.first);
+      s.lru.pop_back();
+      ++s.evictions;
+    }
+    s.lru.push_front(std::make_pair(key, value));
+    s.index[key] = s.lru.begin();
+    s.bytes += c;
+    ++s.inserts;
+  }
+
+  // forget everything, such as when the model changes.  counters are kept
+  void clear()
+  {
+    for (std::vector< shard * >::iterator it = shards_.begin(); it != shards_.end(); ++it)
+    {
+      boost::mutex::scoped_lock lock((*it)->mutex);
+      (*it)->lru.clear();
+      (*it)->index.clear();
+      (*it)->bytes = 0;
+    }
+  }
+
+  // write out hits, misses, and size, in prometheus' text format
+  void write(std::ostream & out)
+  {
+    boost::uint64_t hits = 0, misses = 0, inserts = 0, evictions = 0, entries = 0, bytes = 0;
+    for (std::vector< shard * >::iterator it = shards_.begin(); it != shards_.end(); ++it)
+    {
+      boost::mutex::scoped_lock lock((*it)->mutex);
+      hits += (*it)->hits; misses += (*it)->misses;
+      inserts += (*it)->inserts; evictions += (*it)->evictions;
+      entries += (*it)->index.size(); bytes += (*it)->bytes;
+    }
+    out << "# HELP pfpd_cache_lookups_total parse cache lookups, by whether the parse was there\n";
+    out << "# TYPE pfpd_cache_lookups_total counter\n";
+    out << "pfpd_cache_lookups_total{result=\"hit\"} " << hits << '\n';
+    out << "pfpd_cache_lookups_total{result=\"miss\"} " << misses << '\n';
+    out << "# HELP pfpd_cache_inserts_total parses added to the cache\n";
+    out << "# TYPE pfpd_cache_inserts_total counter\n";
+    out << "pfpd_cache_inserts_total " << inserts << '\n';
+    out << "# HELP pfpd_cache_evictions_total parses dropped from the cache to make room\n";
+    out << "# TYPE pfpd_cache_evictions_total counter\n";
+    out << "pfpd_cache_evictions_total " << evictions << '\n';
+    out << "# HELP pfpd_cache_entries parses in the cache\n";
+    out << "# TYPE pfpd_cache_entries gauge\n";
+    out << "pfpd_cache_entries " << entries << '\n';
+    out << "# HELP pfpd_cache_bytes approximate memory held by the cache\n";
+    out << "# TYPE pfpd_cache_bytes gauge\n";
+    out << "pfpd_cache_bytes " << bytes << '\n';
+    out << "# HELP pfpd_cache_max_bytes the most memory the cache may hold\n";
+    out << "# TYPE pfpd_cache_max_bytes gauge\n";
+    out << "pfpd_cache_max_bytes " << shard_bytes_ * shards_.size() << '\n';
+  }
+};
+
+}}} // com::wavii::pfp
+
+#endif // __PARSE_CACHE_HPP__
@@ -4,18 +4,30 @@
 #include <vector>
 #include <string>
 
+#include <boost/bind.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 #include <moost/http.hpp>
-#include "resource_stack.hpp"
+#include "workspace_pool.hpp"
+#include "job_queue.hpp"
+#include "server_stats.hpp"
+#include "parse_cache.hpp"
+#include "single_flight.hpp"
 
 #include <pfp/tokenizer.h>
+#include <pfp/document_tokenizer.hpp>
 #include <pfp/state_list.hpp>
 #include <pfp/lexicon.hpp>
 #include <pfp/unary_grammar.hpp>
 #include <pfp/binary_grammar.hpp>
 #include <pfp/binary_grammar.hpp>
 #include <pfp/pcfg_parser.hpp>
+#include <pfp/sentence_splitter.hpp>
+#include <pfp/tagger.hpp>
+#include <pfp/tree_writer.hpp>
 
 namespace com { namespace wavii { namespace pfp {
 
@@ -23,14 +35,46 @@ class pfpd_handler : public moost::http::request_handler_base<pfpd_handler>
 {
 private:
 
+  // a parse only holds a workspace for its chart and backtrace.  with more workers than workspaces,
+  // some tokenize, lexicon-score, and stitch while others are in the chart, keeping the workspaces busy
+  static const size_t workers_per_workspace = 2;
+
+  // workspaces come in this many sizes, so short sentences don't tie up long charts
+  static const size_t workspace_classes = 3;
+
+  // how a chart came out.  short of a parse, the best fragments are read back out of it instead,
+  // worst last
+  enum chart_t { parsed, fragmented, timed_out };
+
+  // a piece of a sentence split by splitter_, and how its parse went
+  struct segment
+  {
+    std::vector< std::vector< state_score_t > > sentence_f;
+    node                                         result;
+    parse_stats                                  counted;
+    chart_t                                      outcome;
+    bool                                         failed;
+    std::string                                  error;
+
+    segment() : outcome(parsed), failed(false) {}
+  };
+
   tokenizer tokenizer_;
   state_list states_;
   lexicon lexicon_;
   unary_grammar ug_;
   binary_grammar bg_;
   pcfg_parser pcfg_;
+  boost::scoped_ptr< tagger > tagger_;  // made on first use: most servers never tag
+  boost::mutex tagger_mutex_;
   size_t timer_bucket_size_;
-  resource_stack< workspace > workspaces_;
+  size_t threads_;
+  workspace_pool workspaces_;
+  server_stats stats_;
+  parse_cache cache_;
+  single_flight in_flight_;
+  boost::scoped_ptr< sentence_splitter > splitter_;
+  job_queue jobs_;
 
   // perform utf-8 encoded URL-decoding on a string. returns false if the encoding was invalid
   static bool url_decode(const std::string& in, std::string& out);
@@ -38,17 +82,182 @@ private:
   // provide a version string
   std::string version();
 
+  // provide our counters and latency histograms, in prometheus' text format
+  std::string stats();
+
   // provide a little get-console for interactive parsing
   std::string console(const std::string & query);
 
   // tokenize, lexicon-weight, and parse a sentence
-  std::string parse(const std::string & sentence);
+  std::string parse(const std::string & sentence, const boost::posix_time::ptime & deadline = no_deadline(), parse_stats * work = 0,
+                    tree_format format = bracket_format);
+
+  // lexicon-weight and parse an already tokenized sentence, or find it in the cache, or wait on an
+  // identical parse that's already running.  throws parse_timeout
+  // past the deadline.  if work isn't null, the chart's work is counted and added to it.
+  // the parse is written out in format, and cached that way
+  std::string parse_words(const std::vector< std::string > & words, const boost::posix_time::ptime & deadline = no_deadline(),
+                          parse_stats * work = 0, tree_format format = bracket_format);
+
+  // parse_words, without looking in the cache.  a sentence that runs out of time comes back as fragments,
+  // and sets partial: a parse with more time might do better, so it shouldn't be cached.  if wanted
+  // isn't null, the result is the spans of the states it marks rather than the whole tree
+  std::string parse_uncached(const std::vector< std::string > & words, const boost::posix_time::ptime & deadline,
+                             parse_stats * work, bool & partial, const std::vector< bool > * wanted = 0,
+                             tree_format format = bracket_format);
+
+  // parse an already tokenized sentence for just the spans of the states marked in wanted.  spans aren't
+  // cached: the cache holds whole parses
+  std::string span_words(const std::vector< std::string > & words, const std::vector< bool > & wanted,
+                         const boost::posix_time::ptime & deadline = no_deadline(), parse_stats * work = 0);
+
+  // mark the states of the basic categories in a comma-separated list such as NP,VP.  an empty list marks
+  // every constituent
+  void select_labels(const std::string & labels, std::vector< bool > & wanted);
+
+  // fill a chart for the sentence in ws and read back the best parse, counting work if it isn't null.
+  // if there's no parse, or the deadline passes, read back the best fragments instead.  if wanted
+  // isn't null, fill spans with the spans of the states it marks instead of building result where we can
+  template<class Workspace>
+  chart_t chart(const std::vector< std::vector< state_score_t > > & sentence_f, Workspace & ws,
+                const boost::posix_time::ptime & deadline, parse_stats * work, node & result,
+                const std::vector< bool > * wanted = 0, std::vector< span > * spans = 0);
+
+  // get a workspace that fits the sentence, and chart it there
+  chart_t chart(const std::vector< std::vector< state_score_t > > & sentence_f, const boost::posix_time::ptime & deadline,
+                parse_stats * work, node & result, const std::vector< bool > * wanted = 0, std::vector< span > * spans = 0);
+
+  // chart segment i of a split sentence.  run on each of the segments by the workers a split parse is
+  // spread over.  returns true to carry on
+  bool chart_segment(std::vector< segment > & segments, const boost::posix_time::ptime & deadline, bool counting, size_t i);
+
+  // parse_uncached into out, and cache the result under key, unless it's been cached since we last
+  // looked.  caching before the call is done means there's no moment when a sentence is neither in the
+  // cache nor in flight.  a partial parse, one that ran out of time, isn't cached, and returns false:
+  // it's only good enough for its own caller, so anyone waiting on it parses for themselves
+  bool parse_and_cache(const std::vector< std::string > & words, const boost::posix_time::ptime & deadline,
+                       const std::string & key, parse_stats * work, tree_format format, std::string & out);
+
+  // add one sentence's result to the output of a request that has many.  brackets and spans take a line
+  // each, and json too, with null for a sentence that failed.  binary results are prefixed by their length
+  static void append_result(std::string & out, const std::string & result, tree_format format);
+
+  // the content type of parses in a format, one or many of them
+  static const char * content_type(tree_format format, bool many);
+
+  // the tagger, deriving its model from the grammar the first time it's needed
+  tagger & get_tagger();
+
+  // tokenize and tag a sentence without parsing it, as word/TAG pairs
+  std::string tag(const std::string & sentence);
+
+  // tag an already tokenized sentence
+  std::string tag_words(const std::vector< std::string > & words);
+
+  // tag a batch of sentences, one per line, raw text or a json array of strings as for parse_batch.
+  // returns one line of tags per line, in input order
+  std::string tag_lines(const std::string & content);
+
+  // split a document into sentences and parse each, one parse per line.  sentences not begun by the
+  // deadline are left out
+  std::string parse_document(const std::string & text, const boost::posix_time::ptime & deadline, parse_stats * work = 0,
+                             tree_format format = bracket_format);
+
+  // parse a batch of sentences, one per line, across the workspace pool.  a line is either raw text
+  // or a pre-tokenized json array of strings.  returns one parse per line, in input order, or if wanted
+  // isn't null, one line of spans.  lines not begun by the deadline come back empty
+  std::string parse_batch(const std::string & lines, const boost::posix_time::ptime & deadline, parse_stats * work = 0,
+                          const std::vector< bool > * wanted = 0, tree_format format = bracket_format);
+
+  // parse line i of a batch into results[i], counting its work into (*counted)[i] if counted isn't null.
+  // run on each of the lines by the workers a parse_batch is spread over.  returns true to carry on
+  bool parse_batch_line(const std::vector< std::string > & lines, std::vector< std::string > & results,
+                        std::vector< parse_stats > * counted, const boost::posix_time::ptime & deadline,
+                        const std::vector< bool > * wanted, tree_format format, size_t i);
+
+  // parse a json array of strings such as ["I","love","monkeys","."].  returns false if it's malformed
+  static bool json_string_array(const std::string & in, std::vector< std::string > & out);
+
+  // requests cheap enough to answer on the i/o thread rather than queueing
+  static bool is_inline(const moost::http::request& req);
+
+  // estimating a request's cost runs on the i/o thread, so it only looks up this many of the request's
+  // words in the lexicon.  the rest are taken to be as ambiguous as those were on average
+  static const size_t max_cost_lookups = 64;
+
+  // the words of a request looked up so far, and how many states they can take between them
+  struct cost_sample
+  {
+    size_t lookups;
+    size_t ambiguity;
+
+    cost_sample() : lookups(0), ambiguity(0) {}
+  };
+
+  // count the words of some text, and how many states they can take between them, adding to sample
+  // until it's full and estimating from it after that
+  void measure(const std::string & text, cost_sample & sample, size_t & length, size_t & ambiguity);
+
+  // estimate the cost of parsing a sentence, as its length squared times its total ambiguity
+  double sentence_cost(const std::string & sentence, cost_sample & sample);
+
+  // estimate the cost of a request, so the worker queue can run cheap requests first
+  double request_cost(const moost::http::request& req);
+
+  static boost::posix_time::ptime no_deadline() { return boost::posix_time::ptime(boost::posix_time::pos_infin); }
+
+  // the time a client gives us to answer, from an X-Timeout-Ms header or a timeout=<ms> query
+  // parameter, which is taken off uri.  infinite if it gives none
+  static boost::posix_time::time_duration request_timeout(const moost::http::request& req, std::string & uri);
+
+  // find a name=<value> query parameter in uri, and take it off.  returns false if there's none
+  static bool take_param(std::string & uri, const std::string & name, std::string & value);
+
+  // handle a request that arrived at a given time
+  void handle_request(const moost::http::request& req, moost::http::reply& rep, const boost::posix_time::ptime & arrival);
+
+  // run a queued request on a worker thread
+  template<class Completion>
+  void run_request(const moost::http::request& req, moost::http::reply& rep, Completion done, boost::posix_time::ptime arrival)
+  {
+    handle_request(req, rep, arrival);
+    stats_.record_request(server_stats::elapsed_us(arrival));
+    done();
+  }
 
 public:
 
   pfpd_handler();
 
-  void init(size_t sentence_length, size_t threads, const std::string & data_dir);
+  // load everything, make room for threads workspaces of each size class up to sentence_length,
+  // and start parse workers behind a queue of up to queue_length requests.  parses are cached in up to cache_bytes of memory, and the cache is emptied on every load.
+  // sentences too long for the largest class are split where it's safe, and the pieces parsed in parallel
+  void init(size_t sentence_length, size_t threads, const std::string & data_dir, size_t queue_length,
+            size_t cache_bytes);
+
+  // parses go to the worker pool, cheapest first, so the i/o threads never wait on a workspace.
+  // if the queue is full, answer 503 straight away.  a client's timeout runs from here, so time
+  // spent queued counts against it
+  template<class Completion>
+  void handle_request_async(const moost::http::request& req, moost::http::reply& rep, Completion done)
+  {
+    if (is_inline(req))
+    {
+      handle_request_base(req, rep);
+      done();
+    }
+    else if (!jobs_.push(boost::bind(&pfpd_handler::run_request<Completion>, this, boost::cref(req), boost::ref(rep), done,
+                                     boost::posix_time::microsec_clock::universal_time()),
+                         request_cost(req)))
+    {
+      stats_.count(server_stats::rejected);
+      rep = moost::http::reply::stock_reply(moost::http::reply::service_unavailable);
+      rep.headers.push_back(moost::http::header());
+      rep.headers.back().name = "Retry-After";
+      rep.headers.back().value = "1";
+      done();
+    }
+  }
 
   void handle_request(const moost::http::request& req, moost::http::reply& rep);
 
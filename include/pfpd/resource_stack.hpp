@@ -14,11 +14,14 @@ class resource_stack
 private:
 
   std::stack< T * > resources_;
+  size_t            size_;
   boost::mutex      mutex_;
   boost::condition  cond_;
 
 public:
 
+  resource_stack() : size_(0) {}
+
   ~resource_stack()
   {
     while (!resources_.empty())
@@ -58,8 +61,23 @@ public:
   {
     boost::mutex::scoped_lock lock(mutex_);
     resources_.push(presource);
+    ++size_;
     cond_.notify_one();
   }
+
+  // how many resources we own
+  size_t size()
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    return size_;
+  }
+
+  // how many resources are free right now
+  size_t available()
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    return resources_.size();
+  }
 };
 
 }}} // com::wavii::pfp
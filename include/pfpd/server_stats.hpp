@@ -0,0 +1,278 @@
+#ifndef __SERVER_STATS_HPP__
+#define __SERVER_STATS_HPP__
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include <pfp/pcfg_parser.hpp>
+
+namespace com { namespace wavii { namespace pfp {
+
+// latency histograms and counters for pfpd, exported in prometheus' text format.
+// each thread records into its own block of counters, so recording never locks
+// or contends: only the owning thread writes a block, and /stats reads them all.
+// blocks of threads that exit are folded into a retired block.
+// must outlive every thread that records into it
+class server_stats : private boost::noncopyable
+{
+public:
+
+  // the phases of handling a sentence, timed by sentence length.  wait is time spent waiting for a workspace,
+  // and tag is the whole of tagging a sentence without a chart
+  enum phase_t { tokenize, lexicon, wait, chart, backtrace, stitch, tag, num_phases };
+
+  // things we count
+  enum counter_t { requests, sentences, parse_failures, parse_errors, timeouts, rejected, coalesced, fallbacks, num_counters };
+
+  // sentence lengths are bucketed by bucket_size, with a last bucket for anything longer
+  static const size_t num_lengths = 11;
+
+  // latency bucket upper bounds in microseconds, and a last bucket for anything slower
+  static const size_t num_latencies = 16;
+
+  // the fields of parse_stats, summed
+  static const size_t num_work = 10;
+
+private:
+
+  typedef boost::atomic< boost::uint64_t > cell_t;
+
+  struct histogram
+  {
+    cell_t count[num_latencies];
+    cell_t sum_us;
+  };
+
+  struct block
+  {
+    server_stats * owner;
+    histogram      phases[num_phases][num_lengths];
+    histogram      latency;
+    cell_t         counters[num_counters];
+    cell_t         work[num_work];
+
+    block(server_stats * owner_) : owner(owner_)
+    {
+      for (size_t p = 0; p != num_phases; ++p)
+        for (size_t l = 0; l != num_lengths; ++l)
+          clear(phases[p][l]);
+      clear(latency);
+      for (size_t c = 0; c != num_counters; ++c)
+        counters[c].store(0, boost::memory_order_relaxed);
+      for (size_t w = 0; w != num_work; ++w)
+        work[w].store(0, boost::memory_order_relaxed);
+    }
+
+    static void clear(histogram & h)
+    {
+      for (size_t i = 0; i != num_latencies; ++i)
+        h.count[i].store(0, boost::memory_order_relaxed);
+      h.sum_us.store(0, boost::memory_order_relaxed);
+    }
+  };
+
+  size_t                                  bucket_size_;
+  std::vector< block * >                  blocks_;   // one per live thread
+  block                                   retired_;  // sums of threads that have exited
+  boost::mutex                            mutex_;    // guards blocks_ and retired_
+  boost::thread_specific_ptr< block >     block_;
+
+  // only the owning thread ever writes a cell, so a plain load and store will do
+  static void add(cell_t & c, boost::uint64_t n)
+  {
+    c.store(c.load(boost::memory_order_relaxed) + n, boost::memory_order_relaxed);
+  }
+
+  static void add(histogram & h, boost::uint64_t us)
+  {
+    static const boost::uint64_t bounds[num_latencies - 1] =
+    { 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000 };
+    // the first bucket whose bound we're within
+    add(h.count[std::lower_bound(bounds, bounds + num_latencies - 1, us) - bounds], 1);
+    add(h.sum_us, us);
+  }
+
+  static void add(histogram & to, const histogram & from)
+  {
+    for (size_t i = 0; i != num_latencies; ++i)
+      add(to.count[i], from.count[i].load(boost::memory_order_relaxed));
+    add(to.sum_us, from.sum_us.load(boost::memory_order_relaxed));
+  }
+
+  static void add(block & to, const block & from)
+  {
+    for (size_t p = 0; p != num_phases; ++p)
+      for (size_t l = 0; l != num_lengths; ++l)
+        add(to.phases[p][l], from.phases[p][l]);
+    add(to.latency, from.latency);
+    for (size_t c = 0; c != num_counters; ++c)
+      add(to.counters[c], from.counters[c].load(boost::memory_order_relaxed));
+    for (size_t w = 0; w != num_work; ++w)
+      add(to.work[w], from.work[w].load(boost::memory_order_relaxed));
+  }
+
+  // called as a thread exits: keep its counts, drop its block
+  static void retire(block * b)
+  {
+    server_stats & s = *b->owner;
+    boost::mutex::scoped_lock lock(s.mutex_);
+    add(s.retired_, *b);
+    s.blocks_.erase(std::find(s.blocks_.begin(), s.blocks_.end(), b));
+    delete b;
+  }
+
+  block & local()
+  {
+    block * b = block_.get();
+    if (!b)
+    {
+      b = new block(this);
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        blocks_.push_back(b);
+      }
+      block_.reset(b);
+    }
+    return *b;
+  }
+
+  static void write_histogram(std::ostream & out, const std::string & name, const std::string & labels, const histogram & h)
+  {
+    static const char * les[num_latencies] =
+    { "0.0001", "0.00025", "0.0005", "0.001", "0.0025", "0.005", "0.01", "0.025", "0.05", "0.1", "0.25", "0.5", "1", "2.5", "5", "+Inf" };
+    boost::uint64_t cumulative = 0;
+    for (size_t i = 0; i != num_latencies; ++i)
+    {
+      cumulative += h.count[i].load(boost::memory_order_relaxed);
+      out << name << "_bucket{" << labels << (labels.empty() ? "" : ",") << "le=\"" << les[i] << "\"} " << cumulative << '\n';
+    }
+    out << name << "_sum" << (labels.empty() ? "" : "{" + labels + "}") << ' ' << h.sum_us.load(boost::memory_order_relaxed) / 1e6 << '\n';
+    out << name << "_count" << (labels.empty() ? "" : "{" + labels + "}") << ' ' << cumulative << '\n';
+  }
+
+public:
+
+  server_stats() : bucket_size_(5), retired_(this), block_(&server_stats::retire) {}
+
+  ~server_stats()
+  {
+    block_.reset();
+    for (std::vector< block * >::iterator it = blocks_.begin(); it != blocks_.end(); ++it)
+      delete *it;
+  }
+
+  // bucket sentence lengths in steps of bucket_size
+  void init(size_t bucket_size)
+  {
+    bucket_size_ = std::max< size_t >(bucket_size, 1);
+  }
+
+  // microseconds since start
+  static boost::uint64_t elapsed_us(const boost::posix_time::ptime & start)
+  {
+    boost::posix_time::time_duration d = boost::posix_time::microsec_clock::universal_time() - start;
+    return d.is_negative() ? 0 : d.total_microseconds();
+  }
+
+  // record time spent in a phase for a sentence of a given length
+  void record(phase_t phase, size_t length, boost::uint64_t us)
+  {
+    add(local().phases[phase][std::min(length / bucket_size_, num_lengths - 1)], us);
+  }
+
+  // record the time to answer a request, from when it arrived
+  void record_request(boost::uint64_t us)
+  {
+    add(local().latency, us);
+  }
+
+  void count(counter_t counter, boost::uint64_t n = 1)
+  {
+    add(local().counters[counter], n);
+  }
+
+  // record the work a parse did
+  void record(const parse_stats & s)
+  {
+    cell_t * work = local().work;
+    add(work[0], s.cells); add(work[1], s.seen_states);
+    add(work[2], s.binary_rules); add(work[3], s.binary_pruned); add(work[4], s.splits);
+    add(work[5], s.puts_new); add(work[6], s.puts_updated); add(work[7], s.puts_ignored);
+    add(work[8], s.unaries); add(work[9], s.backtrace_steps);
+  }
+
+  // write out everything, along with a few gauges the caller knows, in prometheus' text format
+  void write(std::ostream & out, size_t queue_depth)
+  {
+    block total(this);
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      add(total, retired_);
+      for (std::vector< block * >::const_iterator it = blocks_.begin(); it != blocks_.end(); ++it)
+        add(total, **it);
+    }
+
+    static const char * counter_names[num_counters] = { "requests", "sentences", "parse_failures", "parse_errors", "timeouts", "rejected", "coalesced", "fallbacks" };
+    static const char * counter_help[num_counters] =
+    {
+      "requests handled",
+      "sentences parsed or attempted",
+      "sentences the grammar found no parse for",
+      "sentences that failed with an error",
+      "requests or sentences that ran out of time",
+      "requests turned away because the queue was full",
+      "sentences answered by joining an identical parse already running",
+      "sentences answered with fragments, for want of a parse or of time"
+    };
+    for (size_t c = 0; c != num_counters; ++c)
+    {
+      out << "# HELP pfpd_" << counter_names[c] << "_total " << counter_help[c] << '\n';
+      out << "# TYPE pfpd_" << counter_names[c] << "_total counter\n";
+      out << "pfpd_" << counter_names[c] << "_total " << total.counters[c].load(boost::memory_order_relaxed) << '\n';
+    }
+
+    static const char * work_names[num_work] =
+    { "cells", "seen_states", "binary_rules", "binary_pruned", "splits", "puts_new", "puts_updated", "puts_ignored", "unaries", "backtrace_steps" };
+    out << "# HELP pfpd_parse_work_total work done by the chart parser, as counted by parse_stats\n";
+    out << "# TYPE pfpd_parse_work_total counter\n";
+    for (size_t w = 0; w != num_work; ++w)
+      out << "pfpd_parse_work_total{count=\"" << work_names[w] << "\"} " << total.work[w].load(boost::memory_order_relaxed) << '\n';
+
+    out << "# HELP pfpd_queue_depth requests waiting for a parse worker\n";
+    out << "# TYPE pfpd_queue_depth gauge\n";
+    out << "pfpd_queue_depth " << queue_depth << '\n';
+
+    out << "# HELP pfpd_request_seconds time to answer a request, queueing included\n";
+    out << "# TYPE pfpd_request_seconds histogram\n";
+    write_histogram(out, "pfpd_request_seconds", "", total.latency);
+
+    static const char * phase_names[num_phases] = { "tokenize", "lexicon", "wait", "chart", "backtrace", "stitch", "tag" };
+    out << "# HELP pfpd_phase_seconds time spent in each phase of a parse, by sentence length\n";
+    out << "# TYPE pfpd_phase_seconds histogram\n";
+    for (size_t p = 0; p != num_phases; ++p)
+    {
+      for (size_t l = 0; l != num_lengths; ++l)
+      {
+        std::ostringstream labels;
+        labels << "phase=\"" << phase_names[p] << "\",length=\"" << l * bucket_size_;
+        if (l + 1 != num_lengths)
+          labels << '-' << (l + 1) * bucket_size_ - 1 << '"';
+        else
+          labels << "+\"";
+        write_histogram(out, "pfpd_phase_seconds", labels.str(), total.phases[p][l]);
+      }
+    }
+  }
+};
+
+}}} // com::wavii::pfp
+
+#endif // __SERVER_STATS_HPP__
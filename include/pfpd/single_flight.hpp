@@ -0,0 +1,113 @@
+#ifndef __SINGLE_FLIGHT_HPP__
+#define __SINGLE_FLIGHT_HPP__
+
+#include <map>
+#include <string>
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+namespace com { namespace wavii { namespace pfp {
+
+// runs at most one call per key at a time.  a thread asking for a key that's
+// already being worked on waits for that call's result instead of starting its own.
+// if the call fails, or its result is only good enough for its own caller, say because
+// it ran out of its own time, the waiters try again, and one of them takes over
+class single_flight : private boost::noncopyable
+{
+private:
+
+  struct call
+  {
+    bool              done;
+    bool              ok;
+    std::string       result;
+    boost::condition  cond;
+
+    call() : done(false), ok(false) {}
+  };
+
+  typedef std::map< std::string, boost::shared_ptr< call > > calls_t;
+
+  calls_t       calls_;
+  boost::mutex  mutex_;
+
+  // wait for c to finish, returning false if the deadline passes first
+  static bool wait(boost::mutex::scoped_lock & lock, call & c, const boost::posix_time::ptime & deadline)
+  {
+    while (!c.done)
+    {
+      if (deadline.is_pos_infinity())
+        c.cond.wait(lock);
+      else if (!c.cond.timed_wait(lock, deadline))
+        return c.done;
+    }
+    return true;
+  }
+
+  void finish(boost::mutex::scoped_lock & lock, const std::string & key, call & c)
+  {
+    lock.lock();
+    c.done = true;
+    calls_.erase(key);
+    c.cond.notify_all();
+  }
+
+public:
+
+  // set result by calling fn(result), or take it from whoever was already running it.  fn
+  // returns whether its result can go to the others waiting on it: if it can't, they run
+  // their own.  shared is set if the result came from another thread's call.  returns false
+  // if the deadline passed while waiting on someone else.  if our own fn throws, so do we
+  template<class Fn>
+  bool run(const std::string & key, Fn fn, const boost::posix_time::ptime & deadline, std::string & result, bool & shared)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    for (calls_t::iterator it; (it = calls_.find(key)) != calls_.end(); )
+    {
+      boost::shared_ptr< call > c = it->second;
+      if (!wait(lock, *c, deadline))
+        return false;
+      if (c->ok)
+      {
+        result = c->result;
+        shared = true;
+        return true;
+      }
+    }
+    boost::shared_ptr< call > c(new call);
+    calls_[key] = c;
+    lock.unlock();
+    bool ok;
+    try
+    {
+      ok = fn(result);
+    }
+    catch (...)
+    {
+      finish(lock, key, *c);
+      throw;
+    }
+    if (ok)
+    {
+      c->result = result; // no one reads it until done is set, under the lock
+      c->ok = true;
+    }
+    finish(lock, key, *c);
+    shared = false;
+    return true;
+  }
+
+  // how many calls are running
+  size_t size()
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    return calls_.size();
+  }
+};
+
+}}} // com::wavii::pfp
+
+#endif // __SINGLE_FLIGHT_HPP__
@@ -0,0 +1,199 @@
+#ifndef __WORKSPACE_POOL_HPP__
+#define __WORKSPACE_POOL_HPP__
+
+#include <vector>
+#include <ostream>
+#include <stdexcept>
+#include <sstream>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+
+#include <pfp/config.h>
+#include <pfp/util.hpp>
+
+namespace com { namespace wavii { namespace pfp {
+
+// workspaces pooled by size class.  a chart's memory grows with the square of its
+// length, so a short sentence gets a small workspace rather than tying up a big one.
+// each class grows on demand up to a limit, and a sentence takes the smallest class
+// that fits and has a workspace free or room to grow, waiting if there's none.
+// sentences longer than the largest class get a sparse_workspace made to measure, a
+// few at a time, which is freed as soon as they're done
+class workspace_pool : private boost::noncopyable
+{
+private:
+
+  struct size_class
+  {
+    pos_t                      words;
+    size_t                     count;  // allocated
+    size_t                     max;    // the most we'll allocate
+    std::vector< workspace * > free;
+  };
+
+  std::vector< size_class >    classes_;    // smallest first
+  state_t                      states_;
+  size_t                       oversized_;  // sparse workspaces out right now
+  size_t                       max_oversized_;
+  boost::mutex                 mutex_;
+  boost::condition             cond_;
+
+  void release(workspace * pw, size_t c)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    classes_[c].free.push_back(pw);
+    // waiters want different classes, so wake them all and let them sort it out
+    cond_.notify_all();
+  }
+
+  void release(sparse_workspace * pw)
+  {
+    delete pw;
+    boost::mutex::scoped_lock lock(mutex_);
+    --oversized_;
+    cond_.notify_all();
+  }
+
+public:
+
+  workspace_pool() : states_(0), oversized_(0), max_oversized_(1) {}
+
+  ~workspace_pool()
+  {
+    for (std::vector< size_class >::iterator it = classes_.begin(); it != classes_.end(); ++it)
+      for (std::vector< workspace * >::iterator jt = it->free.begin(); jt != it->free.end(); ++jt)
+        delete *jt;
+  }
+
+  // num_classes classes evenly spaced up to words long, each of up to per_class workspaces.
+  // up to max_oversized longer sentences may be parsed at once, in sparse workspaces
+  void init(pos_t words, size_t num_classes, size_t per_class, state_t states, size_t max_oversized = 1)
+  {
+    states_ = states;
+    max_oversized_ = max_oversized;
+    num_classes = std::max< size_t >(std::min< size_t >(num_classes, words), 1);
+    for (size_t i = 1; i <= num_classes; ++i)
+    {
+      size_class c;
+      c.words = static_cast< pos_t >((words * i + num_classes - 1) / num_classes);
+      c.count = 0;
+      c.max = per_class;
+      classes_.push_back(c);
+    }
+  }
+
+  // the longest sentence a pooled workspace takes, boundary included.  longer ones need a scoped_oversized
+  size_t longest() const
+  {
+    return classes_.empty() ? 0 : classes_.back().words;
+  }
+
+  // raii workspace access, for a sentence of a given length, boundary included, up to longest()
+  class scoped_workspace
+  {
+  private:
+    workspace_pool &  pool_;
+    workspace *       pw_;
+    size_t            class_;
+  public:
+    scoped_workspace(workspace_pool & pool, size_t words) : pool_(pool), pw_(0)
+    {
+      if (words > pool_.longest())
+        throw std::runtime_error("sentence too large for pooled workspaces");
+      boost::mutex::scoped_lock lock(pool_.mutex_);
+      for (;;)
+      {
+        for (class_ = 0; class_ != pool_.classes_.size(); ++class_)
+        {
+          size_class & c = pool_.classes_[class_];
+          if (c.words < words)
+            continue;
+          if (!c.free.empty())
+          {
+            pw_ = c.free.back();
+            c.free.pop_back();
+            return;
+          }
+          if (c.count < c.max)
+          {
+            // claim it before we let go of the lock: allocating a big chart takes a while
+            ++c.count;
+            lock.unlock();
+            try { pw_ = new workspace(c.words, pool_.states_); }
+            catch (...)
+            {
+              lock.lock();
+              --c.count;
+              pool_.cond_.notify_all();
+              throw;
+            }
+            return;
+          }
+        }
+        pool_.cond_.wait(lock);
+      }
+    }
+    ~scoped_workspace()
+    {
+      pool_.release(pw_, class_);
+    }
+    workspace & operator* () { return *pw_; }
+    workspace * operator->() { return pw_; }
+  };
+
+  // raii access to a sparse workspace for a sentence longer than longest(), waiting for
+  // one of the few we allow at a time
+  class scoped_oversized
+  {
+  private:
+    workspace_pool &   pool_;
+    sparse_workspace *  pw_;
+  public:
+    scoped_oversized(workspace_pool & pool, size_t words) : pool_(pool), pw_(0)
+    {
+      if (words > consts::max_sentence_size)
+      {
+        std::ostringstream oss;
+        oss << "sentence too large to parse (" << words << ">" << consts::max_sentence_size << ")";
+        throw std::runtime_error(oss.str());
+      }
+      {
+        boost::mutex::scoped_lock lock(pool_.mutex_);
+        while (pool_.oversized_ >= pool_.max_oversized_)
+          pool_.cond_.wait(lock);
+        ++pool_.oversized_;
+      }
+      try { pw_ = new sparse_workspace(static_cast< pos_t >(words), pool_.states_); }
+      catch (...)
+      {
+        pool_.release(static_cast< sparse_workspace * >(0));
+        throw;
+      }
+    }
+    ~scoped_oversized()
+    {
+      pool_.release(pw_);
+    }
+    sparse_workspace & operator* () { return *pw_; }
+    sparse_workspace * operator->() { return pw_; }
+  };
+
+  // write out how many workspaces of each class are allocated and in use, in prometheus' text format
+  void write(std::ostream & out)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    out << "# HELP pfpd_workspaces parse workspaces, by the longest sentence they take and whether they're in use\n";
+    out << "# TYPE pfpd_workspaces gauge\n";
+    for (std::vector< size_class >::const_iterator it = classes_.begin(); it != classes_.end(); ++it)
+    {
+      out << "pfpd_workspaces{words=\"" << static_cast< int >(it->words) << "\",state=\"busy\"} " << it->count - it->free.size() << '\n';
+      out << "pfpd_workspaces{words=\"" << static_cast< int >(it->words) << "\",state=\"idle\"} " << it->free.size() << '\n';
+    }
+    out << "pfpd_workspaces{words=\"+Inf\",state=\"busy\"} " << oversized_ << '\n';
+  }
+};
+
+}}} // com::wavii::pfp
+
+#endif // __WORKSPACE_POOL_HPP__
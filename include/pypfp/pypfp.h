@@ -3,17 +3,20 @@
 
 #include <boost/python.hpp> // note: must include python at the beginning or it will bitch
 #include <boost/shared_ptr.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 #include <vector>
 #include <string>
 
 #include <pfp/tokenizer.h>
+#include <pfp/document_tokenizer.hpp>
 #include <pfp/state_list.hpp>
 #include <pfp/lexicon.hpp>
 #include <pfp/unary_grammar.hpp>
 #include <pfp/binary_grammar.hpp>
 #include <pfp/binary_grammar.hpp>
 #include <pfp/pcfg_parser.hpp>
+#include <pfp/tagger.hpp>
 
 namespace com { namespace wavii { namespace pfp {
 
@@ -31,9 +34,16 @@ private:
   binary_grammar               bg_;
   pcfg_parser                  pcfg_;
   boost::shared_ptr<workspace> pworkspace_;
+  boost::shared_ptr<tagger>    ptagger_;
 
   void init(size_t sentence_length = 45, const std::string & data_dir = "");
-  std::string _parse_tokens(const std::vector<std::string>& words);
+  std::string _parse_tokens(const std::vector<std::string>& words, const boost::posix_time::ptime & deadline);
+  template<class Workspace>
+  void _chart(const std::vector< std::vector< state_score_t > > & sentence_f, Workspace & ws, const boost::posix_time::ptime & deadline,
+              node & result, const std::vector<bool> * wanted, std::vector<span> & spans);
+  void _chart_tokens(const std::vector<std::string>& words, const boost::posix_time::ptime & deadline, node & result,
+                     const std::vector<bool> * wanted, std::vector<span> & spans);
+  static boost::posix_time::ptime _deadline(size_t timeout_ms);
 
 public:
 
@@ -43,9 +53,20 @@ public:
 
   pypfp(size_t sentence_length, const std::string & data_dir);
 
-  std::string parse(const std::string & sentence);
+  // timeout_ms bounds the whole call, and 0 means no timeout.  running out of time raises RuntimeError
 
-  std::string parse_tokens(const boost::python::list& words);
+  std::string parse(const std::string & sentence, size_t timeout_ms);
+
+  std::string parse_tokens(const boost::python::list& words, size_t timeout_ms);
+
+  boost::python::list parse_document(const std::string & text, size_t timeout_ms);
+
+  // the (label, begin, end) spans of the constituents with the given labels, such as ["NP", "VP"], read
+  // straight from the chart: no tree or brackets.  an empty list of labels gives every constituent
+  boost::python::list parse_spans(const std::string & sentence, const boost::python::list & labels, size_t timeout_ms);
+
+  // tags without parsing, as a list of (word, tag) tuples.  the tagger's model is derived from the grammar on first use
+  boost::python::list tag(const std::string & sentence);
 
 };
 
@@ -14,9 +14,12 @@ import platform
 if platform.platform().startswith('Darwin'):
     if '64bit' in platform.platform():
         os.environ['ARCHFLAGS'] = "-arch x86_64"
-    libraries = ['boost_python-mt', 'boost_filesystem-mt', 'boost_thread-mt', 'boost_regex-mt', 'boost_system-mt', 'icuio', 'icuuc']
+    libraries = ['boost_python-mt', 'boost_filesystem-mt', 'boost_thread-mt', 'boost_system-mt', 'icuio', 'icuuc']
 else:
-    libraries=['boost_python', 'boost_filesystem', 'boost_thread', 'boost_regex', 'boost_system', 'icuio']
+    libraries=['boost_python', 'boost_filesystem', 'boost_thread', 'boost_system', 'icuio']
+
+# PFP_LONG_SENTENCES=1 python setup.py install builds for long sentences, as cmake -DPFP_LONG_SENTENCES=ON does
+define_macros = [('PFP_LONG_SENTENCES', None)] if os.environ.get('PFP_LONG_SENTENCES') else []
 
 setup(
     name='pfp',
@@ -36,6 +39,7 @@ setup(
                    'src/pypfp/pypfp.cpp'],
                   include_dirs=['include'],
                   libraries=libraries,
+                  define_macros=define_macros,
                   extra_compile_args=['-g']
                   ),
         ],
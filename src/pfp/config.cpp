@@ -1,10 +1,17 @@
 #include <pfp/config.h>
 
+#include <limits>
+
 using namespace com::wavii::pfp;
 
 const char * consts::version = "0.1";
 const float consts::score_resolution = 50.0f;
+#ifdef PFP_LONG_SENTENCES
+const score_t consts::empty_score = -(1 << 29); // leaves room below to add two without overflowing
+#else
 const score_t consts::empty_score = -32768;
+#endif
+const size_t consts::max_sentence_size = std::numeric_limits<pos_t>::max() - 1; // bounds use the largest pos_t to mean empty
 const count_t consts::smooth_threshold = 100;
 const float consts::word_smooth_factor = 0.2f;
 const float consts::sig_smooth_factor = 1.0f;
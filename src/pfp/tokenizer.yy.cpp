@@ -8331,6 +8331,9 @@ goto find_rule; \
 
 #include <pfp/tokenizer.h>
 
+// let the output know where each match sits in the input
+#define YY_USER_ACTION yyextra->match(yytext, yyleng);
+
 /* Constrain fraction to only match likely fractions */
 /* not used DOLLAR  {DOLSIGN}[ \t]*{NUMBER}  */
 /* |\( ?{NUMBER} ?\))  # is for pound signs */
@@ -8989,7 +8992,7 @@ YY_RULE_SETUP
 case 53:
 YY_RULE_SETUP
 #line 150 "../etc/tokenizer.flex"
-{ yyextra->put("`"); yyless(1); /* invert quote - using trailing context didn't work.... */ }
+{ yyless(1); yyextra->match(yytext, yyleng); yyextra->put("`"); /* invert quote - using trailing context didn't work.... */ }
 	YY_BREAK
 case 54:
 YY_RULE_SETUP
@@ -10169,3 +10172,37 @@ void com::wavii::pfp::tokenizer::tokenize(const std::string & in, std::vector<st
   yylex(scanner);
   yylex_destroy(scanner);
 }
+
+void com::wavii::pfp::tokenizer::tokenize(const std::string & in, std::vector<span> & out, std::string & arena) const
+{
+  yyscan_t scanner;
+  tokenizer_out to(out, arena, *this);
+  yylex_init_extra(&to,&scanner );
+  YY_BUFFER_STATE b = yy_scan_string(in.c_str(),scanner);
+  // the lexer scans its own copy of in, byte for byte, so offsets carry over
+  to.begin(b->yy_ch_buf);
+  yylex(scanner);
+  yylex_destroy(scanner);
+}
+
+com::wavii::pfp::tokenizer::scanner::scanner()
+{
+  yyscan_t scanner;
+  yylex_init(&scanner);
+  m_scanner = scanner;
+}
+
+com::wavii::pfp::tokenizer::scanner::~scanner()
+{
+  yylex_destroy(m_scanner);
+}
+
+void com::wavii::pfp::tokenizer::scanner::tokenize(const tokenizer & t, const char * in, size_t size, std::vector<span> & out, std::string & arena)
+{
+  tokenizer_out to(out, arena, t);
+  yyset_extra( &to, m_scanner );
+  YY_BUFFER_STATE b = yy_scan_bytes(in, size, m_scanner);
+  to.begin(b->yy_ch_buf);
+  yylex(m_scanner);
+  yy_delete_buffer(b, m_scanner);
+}
@@ -1,41 +1,155 @@
 #include <iostream>
-#include <fstream>
 #include <vector>
-#include <stdexcept>
+#include <algorithm>
 
+#include <boost/bind.hpp>
 #include <boost/lexical_cast.hpp>
-#include <boost/filesystem/operations.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 #include <pfp/config.h>
 #include <pfp/tokenizer.h>
+#include <pfp/document_tokenizer.hpp>
 #include <pfp/state_list.hpp>
 #include <pfp/lexicon.hpp>
 #include <pfp/unary_grammar.hpp>
 #include <pfp/binary_grammar.hpp>
-#include <pfp/binary_grammar.hpp>
 #include <pfp/pcfg_parser.hpp>
+#include <pfp/sentence_splitter.hpp>
+#include <pfp/tagger.hpp>
+#include <pfp/tree_writer.hpp>
+#include <pfpc/sentence_parser.hpp>
+#include <pfpc/ordered_batch.hpp>
 
 using namespace com::wavii::pfp;
 using namespace boost;
-namespace fs = boost::filesystem;
 
-template<class T>
-void load(T & obj, boost::filesystem::path p)
+// write a result to stdout, after its work if we're counting it, which is added to total.  out is reused
+void put(const sentence_parser & parser, const sentence_result & result, bool stats, parse_stats & total, std::string & out)
+{
+  if (stats && !parser.tagging() && !result.failed)
+  {
+    total += result.stats;
+    std::clog << "stats: words=" << result.words << " " << result.stats << std::endl;
+  }
+  out.clear();
+  parser.append(out, result);
+  std::cout << out;
+}
+
+// reads sentences from stdin, a line or a document at a time
+class sentence_reader
+{
+private:
+
+  tokenizer &        tokenizer_;
+  document_tokenizer doc_;
+  bool               document_;
+
+public:
+
+  sentence_reader(tokenizer & tokenizer, bool document) : tokenizer_(tokenizer), doc_(tokenizer, std::cin), document_(document) {}
+
+  // the next sentence's words, in place of what words held.  returns false at the end of the input
+  bool next(std::vector< std::string > & words)
+  {
+    words.clear();
+    if (document_)
+      return doc_.next(words);
+    if (!std::getline(std::cin, line_))
+      return false;
+    tokenizer_.tokenize(line_, words);
+    return true;
+  }
+
+private:
+
+  std::string line_;
+};
+
+typedef ordered_batch< std::vector< std::string >, sentence_result > sentence_batch;
+
+// the reader thread: tokenize sentences into the batch until the input runs out
+void read_sentences(sentence_reader & reader, sentence_batch & batch)
 {
-  if (!fs::exists(p))
-    throw std::runtime_error("can't find " + p.string());
-  std::ifstream in(p.string().c_str());
-  obj.load(in);
+  for (std::vector< std::string > words; reader.next(words); )
+    batch.push(words);
+  batch.close();
+}
+
+// a worker thread: parse sentences from the batch in a workspace of its own until there are none left
+void parse_sentences(const sentence_parser & parser, sentence_batch & batch, size_t sentence_length, state_t num_states)
+{
+  workspace w(sentence_length, num_states);
+  std::vector< std::string > words;
+  sentence_result result;
+  for (size_t seq = 0; batch.pop(seq, words); )
+  {
+    parser(words, w, result);
+    batch.finish(seq, result);
+  }
 }
 
 int main(int argc, char * argv[])
 {
+  // we only use iostreams, so they needn't keep in step with stdio, and can buffer as they like
+  std::ios::sync_with_stdio(false);
+  static char in_buf[1 << 20], out_buf[1 << 20];
+  std::cin.rdbuf()->pubsetbuf(in_buf, sizeof(in_buf));
+  std::cout.rdbuf()->pubsetbuf(out_buf, sizeof(out_buf));
+  // with -j, a reader thread reads cin while this one writes cout.  tied, every read would flush
+  // cout from under the writer.  one thread at a time flushes after each sentence anyway
+  std::cin.tie(0);
+
   std::clog << "pfpc: command line interface for pfp!" << std::endl;
   std::clog << "build: " << __DATE__ << " (" << __TIME__ << ") of pfp version " << consts::version << " (c) Wavii,Inc. 2010" << std::endl;
-  std::clog << "usage: " << argv[0] << " <max sentence length=45> <data dir=/usr/share/pfp/>" << std::endl;
+  std::clog << "usage: " << argv[0] << " [-d] [-s] [-t <ms>] [-f <format>] [-j <threads>] [--stats] [--tag] <max sentence length=45> <data dir=/usr/share/pfp/>" << std::endl;
+  std::clog << "  -d: read stdin as one document and split it into sentences, instead of one sentence per line" << std::endl;
+  std::clog << "  -s: split sentences too long for the workspace at clause boundaries, and parse the pieces separately" << std::endl;
+  std::clog << "  -t: stop parsing a sentence after this many milliseconds, and settle for fragments" << std::endl;
+  std::clog << "  -f: write parses as brackets (the default), json, or binary" << std::endl;
+  std::clog << "  -j: parse on this many threads (0 for one per core), still writing results in input order" << std::endl;
+  std::clog << "  --stats: report the work done by each parse to stderr, and totals at the end" << std::endl;
+  std::clog << "  --tag: don't parse, just tag each word with its part of speech, as word/TAG" << std::endl;
 
-  size_t sentence_length = argc < 2 ? 45 : lexical_cast<size_t>(argv[1]);
-  std::string data_dir = argc < 3 ? "/usr/share/pfp/" : argv[2]; // make install copies files to /usr/share/pfp by default
+  // pull out flags, leaving positional arguments
+  bool document = false, stats = false, split = false, tag = false;
+  posix_time::time_duration timeout(posix_time::pos_infin);
+  tree_format format = bracket_format;
+  size_t threads = 1;
+  std::vector< std::string > args;
+  for (int i = 1; i != argc; ++i)
+  {
+    if (std::string(argv[i]) == "-d")
+      document = true;
+    else if (std::string(argv[i]) == "-s")
+      split = true;
+    else if (std::string(argv[i]) == "--stats")
+      stats = true;
+    else if (std::string(argv[i]) == "--tag")
+      tag = true;
+    else if (std::string(argv[i]) == "-t" && i + 1 != argc)
+      timeout = posix_time::milliseconds(lexical_cast<long>(argv[++i]));
+    else if (std::string(argv[i]) == "-j" && i + 1 != argc)
+    {
+      threads = lexical_cast<size_t>(argv[++i]);
+      if (threads == 0)
+        threads = std::max(thread::hardware_concurrency(), 1u);
+    }
+    else if (std::string(argv[i]) == "-f" && i + 1 != argc)
+    {
+      if (!format_by_name(argv[++i], format))
+      {
+        std::clog << "unknown format " << argv[i] << std::endl;
+        return 1;
+      }
+    }
+    else
+      args.push_back(argv[i]);
+  }
+
+  size_t sentence_length = args.size() < 1 ? 45 : lexical_cast<size_t>(args[0]);
+  std::string data_dir = args.size() < 2 ? "/usr/share/pfp/" : args[1]; // make install copies files to /usr/share/pfp by default
 
   tokenizer tokenizer;
   state_list states;
@@ -45,48 +159,56 @@ int main(int argc, char * argv[])
   pcfg_parser pcfg(states, ug, bg);
 
   std::clog << "loading lexicon and grammar" << std::endl;
-  load(tokenizer, fs::path(data_dir) / "americanizations");
-  load(states, fs::path(data_dir) / "states");
+  load_model(data_dir, tokenizer, states, lexicon, ug, bg);
+  sentence_splitter splitter(states, static_cast< pos_t >(sentence_length) - 1);
+  tagger tagger(states, lexicon, ug, bg);
+  if (tag)
   {
-    fs::path ps[] = { fs::path(data_dir) / "words", fs::path(data_dir) / "sigs", fs::path(data_dir) / "word_state", fs::path(data_dir) / "sig_state" };
-    std::ifstream ins[4];
-    for (int i = 0; i != 4; ++i)
+    std::clog << "deriving the tagger's model from the grammar" << std::endl;
+    tagger.init();
+  }
+  sentence_parser parser(states, lexicon, pcfg, splitter, tagger, split, tag, stats, timeout, format);
+  sentence_reader reader(tokenizer, document);
+
+  std::clog << "ready!  enter " << (document ? "text" : "lines") << " to " << (tag ? "tag:" : "parse:") << std::endl;
+  parse_stats total_stats;
+  sentence_result result;
+  std::string out; // reused for every sentence, so it only grows a few times
+  if (threads == 1)
+  {
+    // one sentence at a time, flushing each, so pfpc answers as you type
+    workspace w(sentence_length, states.size());
+    for (std::vector< std::string > words; reader.next(words); )
     {
-      if (!fs::exists(ps[i]))
-        throw std::runtime_error("can't find " + ps[i].string());
-      ins[i].open(ps[i].string().c_str());
+      parser(words, w, result);
+      put(parser, result, stats, total_stats, out);
+      std::cout.flush();
     }
-    lexicon.load(ins[0], ins[1], ins[2], ins[3]);
   }
-  load(ug, fs::path(data_dir) / "unary_rules");
-  load(bg, fs::path(data_dir) / "binary_rules");
-  workspace w(sentence_length, states.size());
-
-  std::clog << "ready!  enter lines to parse:" << std::endl;
-  for (std::string sentence; std::getline(std::cin, sentence); )
+  else
   {
-    std::vector< std::string > words;
-    std::vector< std::pair< state_t, float > > state_weight;
-    std::vector< std::vector< state_score_t > > sentence_f;
-    node result;
-    tokenizer.tokenize(sentence, words);
-    for (std::vector< std::string >::const_iterator it = words.begin(); it != words.end(); ++it)
+    // one thread reads and tokenizes, the workers parse, and we write results here as their turns come.
+    // the window keeps every worker busy while one sentence takes a long time, without reading the whole input
+    sentence_batch batch(threads * 16);
+    thread_group workers;
+    workers.create_thread(boost::bind(read_sentences, boost::ref(reader), boost::ref(batch)));
+    for (size_t i = 0; i != threads; ++i)
+      workers.create_thread(boost::bind(parse_sentences, boost::cref(parser), boost::ref(batch), sentence_length,
+                                        static_cast< state_t >(states.size())));
+    for (;;)
     {
-      state_weight.clear(); lexicon.score(*it, std::back_inserter(state_weight));
-      sentence_f.push_back(std::vector< state_score_t >(state_weight.size()));
-      // scale by score_resolution in case we are downcasting our weights
-      for (size_t i = 0; i != state_weight.size(); ++i)
-        sentence_f.back()[i] = state_score_t(state_weight[i].first, state_weight[i].second * consts::score_resolution);
+      // only flush when we'd otherwise wait, so a busy pipeline writes in big blocks
+      if (!batch.try_next(result))
+      {
+        std::cout.flush();
+        if (!batch.next(result))
+          break;
+      }
+      put(parser, result, stats, total_stats, out);
     }
-    // add the boundary symbol
-    sentence_f.push_back( std::vector< state_score_t >(1, state_score_t(consts::boundary_state, 0.0f)));
-    // and parse!
-    if (!pcfg.parse(sentence_f, w, result))
-      std::cout << std::endl;
-    // stitch together the results
-    std::ostringstream oss;
-    std::vector< std::string >::iterator word_it = words.begin();
-    stitch(oss, result, word_it, states);
-    std::cout << oss.str() << std::endl;
+    workers.join_all();
   }
+  std::cout.flush();
+  if (stats)
+    std::clog << "stats: total " << total_stats << std::endl;
 }
@@ -0,0 +1,260 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <pfp/config.h>
+#include <pfp/tokenizer.h>
+#include <pfp/state_list.hpp>
+#include <pfp/lexicon.hpp>
+#include <pfp/unary_grammar.hpp>
+#include <pfp/binary_grammar.hpp>
+#include <pfp/pcfg_parser.hpp>
+#include <pfp/sentence_splitter.hpp>
+#include <pfp/tagger.hpp>
+#include <pfp/tree_writer.hpp>
+#include <pfpc/sentence_parser.hpp>
+#include <pfpc/chunk_deques.hpp>
+#include <pfpc/reorder_buffer.hpp>
+#include <pfpc/batch_index.hpp>
+
+using namespace com::wavii::pfp;
+using namespace boost;
+namespace fs = boost::filesystem;
+
+// pfp_batch parses a corpus file, one sentence per line, into an output file, writing parses in input
+// order as pfpc does.  alongside the output goes an index, <output>.idx, which is also the checkpoint
+// (its format is in pfpc/batch_index.hpp).  a chunk's output is flushed before its index line is
+// written, so the index never promises more than the output holds.  if the index is there when
+// pfp_batch starts, it picks up after the last chunk it lists, throwing away any output past it
+
+// what came of one chunk of the input, waiting its turn to be written
+struct chunk_result
+{
+  std::string out;
+  size_t      sentences;
+  parse_stats stats;
+
+  chunk_result() : sentences(0) {}
+};
+
+// parse each line of [begin, end), appending each result to out.  lines are read as getline reads them,
+// so the output's the same as pfpc's
+void parse_chunk(const sentence_parser & parser, const tokenizer & tokenizer, const char * begin, const char * end,
+                 workspace & w, chunk_result & result)
+{
+  result.out.clear();
+  result.sentences = 0;
+  result.stats.clear();
+  std::string line;
+  std::vector< std::string > words;
+  sentence_result sentence;
+  while (begin != end)
+  {
+    const char * eol = static_cast< const char * >(std::memchr(begin, '\n', end - begin));
+    line.assign(begin, eol ? eol : end);
+    begin = eol ? eol + 1 : end;
+    words.clear();
+    tokenizer.tokenize(line, words);
+    parser(words, w, sentence);
+    parser.append(result.out, sentence);
+    if (!sentence.failed)
+      result.stats += sentence.stats;
+    ++result.sentences;
+  }
+}
+
+// a worker thread: parse chunks in a workspace of its own until there are none left
+void parse_chunks(size_t worker, const sentence_parser & parser, const tokenizer & tokenizer, const char * data,
+                  const std::vector< size_t > & bounds, chunk_deques & chunks, reorder_buffer< chunk_result > & writer,
+                  size_t sentence_length, state_t num_states)
+{
+  workspace w(sentence_length, num_states);
+  chunk_result result;
+  for (size_t chunk = 0; chunks.take(worker, chunk); )
+  {
+    writer.wait_room(chunk);
+    parse_chunk(parser, tokenizer, data + bounds[chunk], data + bounds[chunk + 1], w, result);
+    writer.finish(chunk, result);
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  std::clog << "pfp_batch: resumable batch parsing of a corpus with pfp!" << std::endl;
+  std::clog << "build: " << __DATE__ << " (" << __TIME__ << ") of pfp version " << consts::version << " (c) Wavii,Inc. 2010" << std::endl;
+  std::clog << "usage: " << argv[0] << " [-s] [-t <ms>] [-f <format>] [-j <threads>] [-c <kb>] [--stats] <input> <output> <max sentence length=45> <data dir=/usr/share/pfp/>" << std::endl;
+  std::clog << "  -s: split sentences too long for the workspace at clause boundaries, and parse the pieces separately" << std::endl;
+  std::clog << "  -t: stop parsing a sentence after this many milliseconds, and settle for fragments" << std::endl;
+  std::clog << "  -f: write parses as brackets (the default), json, or binary" << std::endl;
+  std::clog << "  -j: parse on this many threads (default one per core)" << std::endl;
+  std::clog << "  -c: cut the input into chunks of about this many kilobytes (default 64).  the output's checkpointed after each" << std::endl;
+  std::clog << "  --stats: report the total work done by the parses to stderr at the end" << std::endl;
+
+  // pull out flags, leaving positional arguments
+  bool stats = false, split = false;
+  posix_time::time_duration timeout(posix_time::pos_infin);
+  tree_format format = bracket_format;
+  std::string format_name = "brackets";
+  size_t threads = 0, chunk_bytes = 64 * 1024;
+  std::vector< std::string > args;
+  for (int i = 1; i != argc; ++i)
+  {
+    if (std::string(argv[i]) == "-s")
+      split = true;
+    else if (std::string(argv[i]) == "--stats")
+      stats = true;
+    else if (std::string(argv[i]) == "-t" && i + 1 != argc)
+      timeout = posix_time::milliseconds(lexical_cast<long>(argv[++i]));
+    else if (std::string(argv[i]) == "-j" && i + 1 != argc)
+      threads = lexical_cast<size_t>(argv[++i]);
+    else if (std::string(argv[i]) == "-c" && i + 1 != argc)
+      chunk_bytes = std::max< size_t >(lexical_cast<size_t>(argv[++i]), 1) * 1024;
+    else if (std::string(argv[i]) == "-f" && i + 1 != argc)
+    {
+      format_name = argv[++i];
+      if (!format_by_name(format_name, format))
+      {
+        std::clog << "unknown format " << format_name << std::endl;
+        return 1;
+      }
+    }
+    else
+      args.push_back(argv[i]);
+  }
+  if (args.size() < 2)
+  {
+    std::clog << "need an input and an output" << std::endl;
+    return 1;
+  }
+  if (threads == 0)
+    threads = std::max(thread::hardware_concurrency(), 1u);
+
+  std::string input_path = args[0], output_path = args[1], index_path = args[1] + ".idx";
+  size_t sentence_length = args.size() < 3 ? 45 : lexical_cast<size_t>(args[2]);
+  std::string data_dir = args.size() < 4 ? "/usr/share/pfp/" : args[3]; // make install copies files to /usr/share/pfp by default
+
+  // a missing input, an output that doesn't match its index, or one we can't write ends the run
+  try
+  {
+    if (!fs::exists(input_path))
+      throw std::runtime_error("can't find " + input_path);
+    uintmax_t input_size = fs::file_size(input_path);
+
+    // pick up where the index says the last run left off, or start over
+    uintmax_t input_begin = 0, output_size = 0, sentences = 0, index_size = 0;
+    if (fs::exists(index_path))
+    {
+      read_checkpoint(index_path, input_size, format_name, input_begin, output_size, sentences, index_size);
+      if (!fs::exists(output_path) || fs::file_size(output_path) < output_size)
+        throw std::runtime_error(output_path + " is shorter than its index says: remove " + index_path + " to start over");
+      fs::resize_file(output_path, output_size);
+      fs::resize_file(index_path, index_size);
+      std::clog << "resuming after " << sentences << " sentences, at byte " << input_begin << " of " << input_size << std::endl;
+    }
+    else
+    {
+      std::ofstream(output_path.c_str(), std::ios::binary | std::ios::trunc);
+      std::ofstream index(index_path.c_str(), std::ios::binary | std::ios::trunc);
+      index << "pfp_batch " << input_size << " " << format_name << "\n";
+    }
+    std::ofstream output(output_path.c_str(), std::ios::binary | std::ios::app);
+    std::ofstream index(index_path.c_str(), std::ios::binary | std::ios::app);
+    if (!output || !index)
+      throw std::runtime_error("can't write " + output_path);
+
+    // map the input, and cut what's left of it into chunks that end at line ends
+    iostreams::mapped_file_source input;
+    const char * data = 0;
+    if (input_size != 0)
+    {
+      input.open(input_path);
+      data = input.data();
+    }
+    std::vector< size_t > bounds(1, static_cast< size_t >(input_begin));
+    while (bounds.back() != input_size)
+    {
+      size_t end = bounds.back() + chunk_bytes;
+      if (end >= input_size)
+        end = static_cast< size_t >(input_size);
+      else
+      {
+        const char * eol = static_cast< const char * >(std::memchr(data + end, '\n', input_size - end));
+        end = eol ? eol - data + 1 : static_cast< size_t >(input_size);
+      }
+      bounds.push_back(end);
+    }
+    size_t num_chunks = bounds.size() - 1;
+
+    tokenizer tokenizer;
+    state_list states;
+    lexicon lexicon(states);
+    unary_grammar ug(states);
+    binary_grammar bg(states);
+    pcfg_parser pcfg(states, ug, bg);
+
+    std::clog << "loading lexicon and grammar" << std::endl;
+    load_model(data_dir, tokenizer, states, lexicon, ug, bg);
+    sentence_splitter splitter(states, static_cast< pos_t >(sentence_length) - 1);
+    tagger tagger(states, lexicon, ug, bg);
+    sentence_parser parser(states, lexicon, pcfg, splitter, tagger, split, false, stats, timeout, format);
+
+    std::clog << "parsing " << num_chunks << " chunks on " << threads << " threads" << std::endl;
+    chunk_deques chunks(threads, 0, num_chunks);
+    // workers wait before starting a chunk too far ahead of the writer, so one slow chunk can't fill memory with results
+    reorder_buffer< chunk_result > writer(threads * 4);
+    writer.close(num_chunks);
+    thread_group workers;
+    for (size_t i = 0; i != threads; ++i)
+      workers.create_thread(boost::bind(parse_chunks, i, boost::cref(parser), boost::cref(tokenizer), data, boost::cref(bounds),
+                                        boost::ref(chunks), boost::ref(writer), sentence_length,
+                                        static_cast< state_t >(states.size())));
+
+    // write chunks as their turns come, checkpointing each
+    posix_time::ptime start = posix_time::microsec_clock::universal_time();
+    parse_stats total_stats;
+    uintmax_t parsed = 0;
+    chunk_result result;
+    for (size_t chunk = 0; writer.next(result); ++chunk)
+    {
+      output.write(result.out.data(), result.out.size());
+      output.flush();
+      if (!output)
+      {
+        // workers waiting on us would wait forever: stop them where they wait, and let them go
+        workers.interrupt_all();
+        workers.join_all();
+        throw std::runtime_error("can't write " + output_path);
+      }
+      output_size += result.out.size();
+      sentences += result.sentences;
+      parsed += result.sentences;
+      index << bounds[chunk + 1] << " " << output_size << " " << sentences << "\n";
+      index.flush();
+      total_stats += result.stats;
+      double seconds = (posix_time::microsec_clock::universal_time() - start).total_milliseconds() / 1000.0;
+      std::clog << "chunk " << chunk + 1 << "/" << num_chunks << ": " << sentences << " sentences, "
+                << bounds[chunk + 1] * 100 / std::max< uintmax_t >(input_size, 1) << "% of the input, "
+                << static_cast< size_t >(parsed / std::max(seconds, 0.001)) << " sentences/s" << std::endl;
+    }
+    workers.join_all();
+    if (stats)
+      std::clog << "stats: total " << total_stats << std::endl;
+    std::clog << "done: " << sentences << " sentences in " << output_path << std::endl;
+  }
+  catch (const std::runtime_error & e)
+  {
+    std::cerr << "error: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -69,18 +69,13 @@ int main(int argc, char * argv[])
     words.push_back(word);
   }
 
-  std::vector< std::pair< state_t, float > > state_weight;
   std::vector< std::vector< state_score_t > > sentence_f;
   node result;
 
   for (std::vector< std::string >::const_iterator it = words.begin(); it != words.end(); ++it)
   {
-    state_weight.clear(); 
-    lexicon.score(*it, std::back_inserter(state_weight));
-    sentence_f.push_back(std::vector< state_score_t >(state_weight.size()));
-    // scale by score_resolution in case we are downcasting our weights
-    for (size_t i = 0; i != state_weight.size(); ++i)
-      sentence_f.back()[i] = state_score_t(state_weight[i].first, state_weight[i].second * consts::score_resolution);
+    sentence_f.push_back(std::vector< state_score_t >());
+    lexicon.chart_score(*it, std::back_inserter(sentence_f.back()));
   }
   // add the boundary symbol
   sentence_f.push_back( std::vector< state_score_t >(1, state_score_t(consts::boundary_state, 0.0f)));
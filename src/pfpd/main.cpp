@@ -16,7 +16,7 @@ int main(int argc, char * argv[])
 
   if (argc < 3)
   {
-    std::cerr << "usage: " << argv[0] << " <host> <port> <max sentence length=45> <threads=1> <data dir=/usr/share/pfp/>" << std::endl;
+    std::cerr << "usage: " << argv[0] << " <host> <port> <max sentence length=45> <threads=1> <data dir=/usr/share/pfp/> <queue length=64> <io threads=1> <cache mb=64>" << std::endl;
     exit(1);
   }
   std::string host = argv[1];
@@ -24,11 +24,15 @@ int main(int argc, char * argv[])
   size_t sentence_length = argc < 4 ? 45 : lexical_cast<size_t>(argv[3]);
   size_t threads = argc < 5 ? 1 : lexical_cast<size_t>(argv[4]);
   std::string data_dir = argc < 6 ? "/usr/share/pfp/" : argv[5]; // make install copies files to /usr/share/pfp by default
+  size_t queue_length = argc < 7 ? 64 : lexical_cast<size_t>(argv[6]);
+  size_t io_threads = argc < 8 ? 1 : lexical_cast<size_t>(argv[7]);
+  size_t cache_mb = argc < 9 ? 64 : lexical_cast<size_t>(argv[8]);
 
-  http::server<pfpd_handler> server(host, port, threads);
+  // threads parse, io_threads only shuttle bytes and never wait on a parse
+  http::server<pfpd_handler> server(host, port, io_threads);
   try
   {
-    server.request_handler().init(sentence_length, threads, data_dir);
+    server.request_handler().init(sentence_length, threads, data_dir, queue_length, cache_mb * 1024 * 1024);
   } catch (const std::runtime_error & e)
   {
     std::cerr << "error: " << e.what() << std::endl;
@@ -33,9 +33,12 @@ void load(T & obj, boost::filesystem::path p)
   obj.load(in);
 }
 
-void pfpd_handler::init(size_t sentence_length, size_t threads, const std::string & data_dir)
+void pfpd_handler::init(size_t sentence_length, size_t threads, const std::string & data_dir, size_t queue_length,
+                        size_t cache_bytes)
 {
   timer_bucket_size_ = (sentence_length + 9) / 10;
+  stats_.init(timer_bucket_size_);
+  threads_ = threads;
   std::clog << "loading lexicon and grammar" << std::endl;
   load(tokenizer_, fs::path(data_dir) / "americanizations");
   load(states_, fs::path(data_dir) / "states");
@@ -52,9 +55,101 @@ void pfpd_handler::init(size_t sentence_length, size_t threads, const std::strin
   }
   load(ug_, fs::path(data_dir) / "unary_rules");
   load(bg_, fs::path(data_dir) / "binary_rules");
-  std::clog << "allocating " << threads << " workspaces of sentence-length " << sentence_length << std::endl;
-  while (threads-- != 0)
-    workspaces_.add_resource(new workspace(sentence_length, states_.size()));
+  {
+    // the tagger's model is derived from the grammar when it's first needed
+    boost::mutex::scoped_lock lock(tagger_mutex_);
+    tagger_.reset();
+  }
+  // parses from any earlier model are no good now
+  std::clog << "caching up to " << cache_bytes / (1024 * 1024) << "mb of parses" << std::endl;
+  cache_.init(cache_bytes);
+  // workspaces are allocated as they're needed, up to threads in each class.  a chart's memory grows with
+  // the square of its length, so with classes at a third, two thirds, and all of the length, the pool can
+  // grow to 1 + 4/9 + 1/9, about 1.56 times what threads full-size workspaces take
+  std::clog << "pooling up to " << threads << " workspaces in each of " << workspace_classes
+            << " size classes up to sentence-length " << sentence_length << std::endl;
+  workspaces_.init(static_cast< pos_t >(std::min(sentence_length, consts::max_sentence_size)), workspace_classes, threads,
+                   states_.size());
+  // a sentence the largest class can't take gets split, if it can be, rather than parsed in an oversized workspace
+  splitter_.reset(new sentence_splitter(states_, workspaces_.longest() - 1));
+  std::clog << "starting " << workers_per_workspace * threads << " parse workers with a queue of " << queue_length << std::endl;
+  // parses run at very roughly 32 units of sentence_cost per microsecond, so at this rate of aging a
+  // long sentence gets overtaken by shorter ones for about as long as it would take to parse
+  jobs_.start(workers_per_workspace * threads, queue_length, 32.0);
+}
+
+bool pfpd_handler::is_inline(const moost::http::request& req)
+{
+  return req.uri == "/version" || req.uri == "/version/" || req.uri == "/stats" || req.uri == "/stats/";
+}
+
+void pfpd_handler::measure(const std::string & text, cost_sample & sample, size_t & length, size_t & ambiguity)
+{
+  // splitting on whitespace is close enough to tokenizing for an estimate, and much cheaper
+  length = ambiguity = 0;
+  std::string word;
+  for (std::string::const_iterator it = text.begin(); ; ++it)
+  {
+    if (it == text.end() || isspace(static_cast<unsigned char>(*it)))
+    {
+      if (!word.empty())
+      {
+        ++length;
+        if (sample.lookups != max_cost_lookups)
+        {
+          size_t a = lexicon_.ambiguity(word);
+          ++sample.lookups;
+          sample.ambiguity += a;
+          ambiguity += a;
+        }
+        else
+          ambiguity += sample.ambiguity / sample.lookups;
+        word.clear();
+      }
+      if (it == text.end())
+        break;
+    }
+    else
+      word += *it;
+  }
+}
+
+double pfpd_handler::sentence_cost(const std::string & sentence, cost_sample & sample)
+{
+  size_t length, ambiguity;
+  measure(sentence, sample, length, ambiguity);
+  return static_cast<double>(length) * length * ambiguity;
+}
+
+double pfpd_handler::request_cost(const moost::http::request& req)
+{
+  std::string uri, request_path;
+  request_timeout(req, uri);
+  if (!url_decode(uri, request_path))
+    return 0.0;
+  cost_sample sample;
+  if (request_path == "/parse" || request_path == "/spans" || ((request_path == "/parse/" || request_path == "/spans/") && req.method == "POST"))
+  {
+    double cost = 0.0;
+    for (size_t begin = 0, end; begin < req.content.size(); begin = end + 1)
+    {
+      end = req.content.find('\n', begin);
+      if (end == std::string::npos)
+        end = req.content.size();
+      cost += sentence_cost(req.content.substr(begin, end - begin), sample);
+    }
+    return cost;
+  }
+  else if (request_path.find("/parse/") == 0 || request_path.find("/spans/") == 0 || request_path.find("/console") == 0)
+    return sentence_cost(request_path, sample);
+  else if (request_path.find("/document") == 0)
+  {
+    // we don't know where the sentences are yet: call them twenty words each
+    size_t length, ambiguity;
+    measure(request_path.size() > sizeof("/document/") - 1 ? request_path : req.content, sample, length, ambiguity);
+    return 20.0 * 20.0 * ambiguity;
+  }
+  return 0.0;
 }
 
 bool pfpd_handler::url_decode(const std::string& in, std::string& out)
@@ -89,10 +184,69 @@ bool pfpd_handler::url_decode(const std::string& in, std::string& out)
   return true;
 }
 
+boost::posix_time::time_duration pfpd_handler::request_timeout(const moost::http::request& req, std::string & uri)
+{
+  boost::posix_time::time_duration timeout(boost::posix_time::pos_infin);
+  uri = req.uri;
+  std::vector<moost::http::header>::const_iterator it = req.find_header("X-Timeout-Ms");
+  if (it != req.headers.end())
+  {
+    try { timeout = boost::posix_time::milliseconds(boost::lexical_cast<long>(it->value)); }
+    catch (const boost::bad_lexical_cast &) {}
+  }
+  std::string value;
+  if (take_param(uri, "timeout", value))
+  {
+    try { timeout = boost::posix_time::milliseconds(boost::lexical_cast<long>(value)); }
+    catch (const boost::bad_lexical_cast &) {}
+  }
+  return timeout;
+}
+
+bool pfpd_handler::take_param(std::string & uri, const std::string & name, std::string & value)
+{
+  // look for name= right after a ? or &
+  std::string key = name + "=";
+  size_t pos = uri.find(key);
+  while (pos != std::string::npos && pos != 0 && uri[pos - 1] != '?' && uri[pos - 1] != '&')
+    pos = uri.find(key, pos + 1);
+  if (pos == std::string::npos || pos == 0)
+    return false;
+  size_t begin = pos + key.size(), end = uri.find('&', pos);
+  value = uri.substr(begin, end == std::string::npos ? end : end - begin);
+  if (end == std::string::npos)
+    uri.erase(pos - 1); // along with its ? or &
+  else
+    uri.erase(pos, end + 1 - pos);
+  return true;
+}
+
 void pfpd_handler::handle_request(const moost::http::request& req, moost::http::reply& rep)
 {
-  std::string request_path;
-  if (!url_decode(req.uri, request_path))
+  handle_request(req, rep, boost::posix_time::microsec_clock::universal_time());
+}
+
+void pfpd_handler::handle_request(const moost::http::request& req, moost::http::reply& rep, const boost::posix_time::ptime & arrival)
+{
+  std::string uri, request_path, value;
+  boost::posix_time::ptime deadline = arrival + request_timeout(req, uri);
+  // counting the chart's work costs a little, so it's only done when asked for with stats=1
+  parse_stats counted, * work = take_param(uri, "stats", value) && value == "1" ? &counted : 0;
+  // the constituents a /spans request wants, as labels=NP,VP
+  std::string labels;
+  if (take_param(uri, "labels", value) && !url_decode(value, labels))
+  {
+    rep = reply::stock_reply(reply::bad_request);
+    return;
+  }
+  // how to write parses: format=brackets, json, or binary
+  tree_format format = bracket_format;
+  if (take_param(uri, "format", value) && !format_by_name(value, format))
+  {
+    rep = reply::stock_reply(reply::bad_request);
+    return;
+  }
+  if (!url_decode(uri, request_path))
   {
     rep = reply::stock_reply(reply::bad_request);
     return;
@@ -103,26 +257,84 @@ void pfpd_handler::handle_request(const moost::http::request& req, moost::http::
   rep.headers[1].name = "Content-Type";
   rep.headers[1].value = "text/plain";
 
+  stats_.count(server_stats::requests);
   try
   {
     rep.status = reply::ok;
     if (request_path == "/version" || request_path == "/version/")
       rep.content = version();
+    else if (request_path == "/stats" || request_path == "/stats/")
+    {
+      rep.content = stats();
+      rep.headers[1].value = "text/plain; version=0.0.4";
+    }
     else if (request_path.find("/console") == 0)
     {
       rep.content = console( request_path.substr(sizeof("/console") - 1) );
       rep.headers[1].value = "text/html";
     }
+    else if (request_path == "/parse" || (request_path == "/parse/" && req.method == "POST"))
+    {
+      rep.content = parse_batch(req.content, deadline, work, 0, format); // POST sentences as the body, one per line
+      rep.headers[1].value = content_type(format, true);
+    }
     else if (request_path.find("/parse/") == 0)
-      rep.content = parse(request_path.substr(sizeof("/parse/") - 1));
+    {
+      rep.content = parse(request_path.substr(sizeof("/parse/") - 1), deadline, work, format);
+      rep.headers[1].value = content_type(format, false);
+    }
+    else if (request_path == "/spans" || (request_path == "/spans/" && req.method == "POST"))
+    {
+      std::vector< bool > wanted;
+      select_labels(labels, wanted);
+      rep.content = parse_batch(req.content, deadline, work, &wanted); // POST sentences as the body, one per line
+    }
+    else if (request_path.find("/spans/") == 0)
+    {
+      std::vector< std::string > words;
+      std::vector< bool > wanted;
+      select_labels(labels, wanted);
+      boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+      tokenizer_.tokenize(request_path.substr(sizeof("/spans/") - 1), words);
+      stats_.record(server_stats::tokenize, words.size(), server_stats::elapsed_us(start));
+      rep.content = span_words(words, wanted, deadline, work);
+    }
+    else if (request_path == "/tag" || (request_path == "/tag/" && req.method == "POST"))
+      rep.content = tag_lines(req.content); // POST sentences as the body, one per line
+    else if (request_path.find("/tag/") == 0)
+      rep.content = tag(request_path.substr(sizeof("/tag/") - 1));
+    else if (request_path == "/document" || request_path == "/document/")
+    {
+      rep.content = parse_document(req.content, deadline, work, format); // POST the document as the body
+      rep.headers[1].value = content_type(format, true);
+    }
+    else if (request_path.find("/document/") == 0)
+    {
+      rep.content = parse_document(request_path.substr(sizeof("/document/") - 1), deadline, work, format);
+      rep.headers[1].value = content_type(format, true);
+    }
     else
       rep = reply::stock_reply(reply::not_found);
+  } catch (const parse_timeout &)
+  {
+    rep = reply::stock_reply(reply::gateway_timeout);
+    return;
   } catch (const std::runtime_error & e)
   {
     std::cerr << "error: " << e.what() << std::endl;
     rep.content = "";
   }
 
+  // what the chart did, if we were asked
+  if (work)
+  {
+    std::ostringstream oss;
+    oss << *work;
+    rep.headers.resize(3);
+    rep.headers[2].name = "X-Parse-Stats";
+    rep.headers[2].value = oss.str();
+  }
+
   // and finally the length
   rep.headers[0].value = boost::lexical_cast<std::string>(rep.content.size());
 }
@@ -149,6 +361,15 @@ std::string pfpd_handler::version()
   return oss.str();
 }
 
+std::string pfpd_handler::stats()
+{
+  std::ostringstream oss;
+  stats_.write(oss, jobs_.size());
+  workspaces_.write(oss);
+  cache_.write(oss);
+  return oss.str();
+}
+
 std::string pfpd_handler::console(const std::string & query)
 {
   std::ostringstream oss;
@@ -170,32 +391,526 @@ std::string pfpd_handler::console(const std::string & query)
   return oss.str();
 }
 
-std::string pfpd_handler::parse(const std::string & sentence)
+std::string pfpd_handler::parse(const std::string & sentence, const boost::posix_time::ptime & deadline, parse_stats * work,
+                                tree_format format)
 {
-  // befirst, get a workspace
-  resource_stack<workspace>::scoped_resource pw(workspaces_);
-  // now some words
   std::vector< std::string > words;
-  std::vector< std::pair< state_t, float > > state_weight;
-  std::vector< std::vector< state_score_t > > sentence_f;
-  node result;
+  boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
   tokenizer_.tokenize(sentence, words);
-  for (std::vector< std::string >::const_iterator it = words.begin(); it != words.end(); ++it)
-  {
-    state_weight.clear(); lexicon_.score(*it, std::back_inserter(state_weight));
-    sentence_f.push_back(std::vector< state_score_t >(state_weight.size()));
-    // scale by score_resolution in case we are downcasting our weights
-    for (size_t i = 0; i != state_weight.size(); ++i)
-      sentence_f.back()[i] = state_score_t(state_weight[i].first, state_weight[i].second * consts::score_resolution);
-  }
-  // add the boundary symbol
-  sentence_f.push_back( std::vector< state_score_t >(1, state_score_t(consts::boundary_state, 0.0f)));
-  // and parse!
-  if (!pcfg_.parse(sentence_f, *pw, result))
-    return "";
-  // stitch together the results
+  stats_.record(server_stats::tokenize, words.size(), server_stats::elapsed_us(start));
+  return parse_words(words, deadline, work, format);
+}
+
+tagger & pfpd_handler::get_tagger()
+{
+  boost::mutex::scoped_lock lock(tagger_mutex_);
+  if (!tagger_)
+  {
+    std::clog << "deriving the tagger's model from the grammar" << std::endl;
+    tagger_.reset(new tagger(states_, lexicon_, ug_, bg_));
+    tagger_->init();
+  }
+  return *tagger_;
+}
+
+std::string pfpd_handler::tag(const std::string & sentence)
+{
+  std::vector< std::string > words;
+  boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+  tokenizer_.tokenize(sentence, words);
+  stats_.record(server_stats::tokenize, words.size(), server_stats::elapsed_us(start));
+  return tag_words(words);
+}
+
+std::string pfpd_handler::tag_words(const std::vector< std::string > & words)
+{
+  std::vector< state_t > tags;
+  boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+  get_tagger().tag(words, tags);
   std::ostringstream oss;
-  stitch(oss, result, words.begin(), states_);
+  stitch_tags(oss, words.begin(), words.end(), tags, states_);
+  stats_.record(server_stats::tag, words.size(), server_stats::elapsed_us(start));
   return oss.str();
 }
 
+std::string pfpd_handler::tag_lines(const std::string & content)
+{
+  // tagging is cheap enough that a batch isn't worth fanning out
+  std::ostringstream oss;
+  for (size_t begin = 0, end, line = 1; begin < content.size(); begin = end + 1, ++line)
+  {
+    end = content.find('\n', begin);
+    if (end == std::string::npos)
+      end = content.size();
+    std::string sentence = content.substr(begin, end - begin);
+    // one bad sentence shouldn't sink the whole batch
+    try
+    {
+      if (!sentence.empty() && sentence[0] == '[')
+      {
+        std::vector< std::string > words;
+        if (json_string_array(sentence, words))
+          oss << tag_words(words);
+        else
+          std::cerr << "error: malformed token array on line " << line << std::endl;
+      }
+      else
+        oss << tag(sentence);
+    }
+    catch (const std::runtime_error & e) { std::cerr << "error: " << e.what() << std::endl; }
+    oss << '\n';
+  }
+  return oss.str();
+}
+
+std::string pfpd_handler::parse_words(const std::vector< std::string > & words, const boost::posix_time::ptime & deadline,
+                                      parse_stats * work, tree_format format)
+{
+  // nothing to parse, and the parser expects at least one word
+  if (words.empty())
+    return "";
+  stats_.count(server_stats::sentences);
+  std::string key = parse_cache::key(words.begin(), words.end()), out;
+  // the same sentence in another format is another entry
+  if (format != bracket_format)
+    key.append(1, '\0').append(1, static_cast< char >('0' + format));
+  // counting work needs a real parse, so a request for stats neither looks in the cache nor joins another's parse
+  if (work)
+  {
+    parse_and_cache(words, deadline, key, work, format, out);
+    return out;
+  }
+  if (cache_.get(key, out))
+    return out;
+  bool shared;
+  if (!in_flight_.run(key,
+                      boost::bind(&pfpd_handler::parse_and_cache, this, boost::cref(words), boost::cref(deadline),
+                                  boost::cref(key), static_cast< parse_stats * >(0), format, _1),
+                      deadline, out, shared))
+  {
+    stats_.count(server_stats::timeouts);
+    throw parse_timeout();
+  }
+  if (shared)
+    stats_.count(server_stats::coalesced);
+  return out;
+}
+
+std::string pfpd_handler::span_words(const std::vector< std::string > & words, const std::vector< bool > & wanted,
+                                     const boost::posix_time::ptime & deadline, parse_stats * work)
+{
+  if (words.empty())
+    return "";
+  stats_.count(server_stats::sentences);
+  bool partial = false;
+  return parse_uncached(words, deadline, work, partial, &wanted);
+}
+
+void pfpd_handler::select_labels(const std::string & labels, std::vector< bool > & wanted)
+{
+  std::vector< std::string > categories;
+  for (size_t begin = 0, end; begin < labels.size(); begin = end + 1)
+  {
+    end = labels.find(',', begin);
+    if (end == std::string::npos)
+      end = labels.size();
+    if (end != begin)
+      categories.push_back(labels.substr(begin, end - begin));
+  }
+  states_.select(categories, wanted);
+}
+
+bool pfpd_handler::parse_and_cache(const std::vector< std::string > & words, const boost::posix_time::ptime & deadline,
+                                   const std::string & key, parse_stats * work, tree_format format, std::string & out)
+{
+  // we missed the cache before we got here, but a parse that was in flight then may have been cached
+  // since.  now that no one else can be parsing it, look again.  counting work needs a real parse, though
+  if (!work && cache_.get(key, out, false))
+    return true;
+  bool partial = false;
+  out = parse_uncached(words, deadline, work, partial, 0, format);
+  if (!partial)
+    cache_.put(key, out);
+  return !partial;
+}
+
+template<class Workspace>
+pfpd_handler::chart_t pfpd_handler::chart(const std::vector< std::vector< state_score_t > > & sentence_f, Workspace & ws,
+                                          const boost::posix_time::ptime & deadline, parse_stats * work, node & result,
+                                          const std::vector< bool > * wanted, std::vector< span > * spans)
+{
+  size_t length = sentence_f.size() - 1; // not counting the boundary
+  boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+  chart_t outcome = parsed;
+  try
+  {
+    if (!(work ? pcfg_.fill(sentence_f, ws, deadline, *work) : pcfg_.fill(sentence_f, ws, deadline)))
+      outcome = fragmented;
+  }
+  catch (const parse_timeout &)
+  {
+    outcome = timed_out;
+  }
+  stats_.record(server_stats::chart, length, server_stats::elapsed_us(start));
+  // the chart's paid for: even without a parse, what's in it is worth reading back
+  start = boost::posix_time::microsec_clock::universal_time();
+  if (outcome == parsed && wanted)
+  {
+    // straight from the chart, with no tree in between
+    if (work)
+      pcfg_.spans(sentence_f, ws, *wanted, *spans, *work);
+    else
+      pcfg_.spans(sentence_f, ws, *wanted, *spans);
+  }
+  else if (outcome == parsed)
+  {
+    if (work)
+      pcfg_.backtrace(sentence_f, ws, result, *work);
+    else
+      pcfg_.backtrace(sentence_f, ws, result);
+  }
+  else if (work)
+    pcfg_.fragments(sentence_f, ws, result, *work);
+  else
+    pcfg_.fragments(sentence_f, ws, result);
+  if (outcome != parsed && wanted)
+  {
+    spans->clear();
+    tree_spans(result, *wanted, *spans);
+  }
+  stats_.record(server_stats::backtrace, length, server_stats::elapsed_us(start));
+  return outcome;
+}
+
+pfpd_handler::chart_t pfpd_handler::chart(const std::vector< std::vector< state_score_t > > & sentence_f,
+                                          const boost::posix_time::ptime & deadline, parse_stats * work, node & result,
+                                          const std::vector< bool > * wanted, std::vector< span > * spans)
+{
+  size_t length = sentence_f.size() - 1;
+  boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+  if (sentence_f.size() <= workspaces_.longest())
+  {
+    workspace_pool::scoped_workspace pw(workspaces_, sentence_f.size());
+    stats_.record(server_stats::wait, length, server_stats::elapsed_us(start));
+    return chart(sentence_f, *pw, deadline, work, result, wanted, spans);
+  }
+  else
+  {
+    workspace_pool::scoped_oversized pw(workspaces_, sentence_f.size());
+    stats_.record(server_stats::wait, length, server_stats::elapsed_us(start));
+    return chart(sentence_f, *pw, deadline, work, result, wanted, spans);
+  }
+}
+
+bool pfpd_handler::chart_segment(std::vector< segment > & segments, const boost::posix_time::ptime & deadline, bool counting,
+                                 size_t i)
+{
+  segment & s = segments[i];
+  try
+  {
+    s.outcome = chart(s.sentence_f, deadline, counting ? &s.counted : 0, s.result);
+  }
+  catch (const std::runtime_error & e)
+  {
+    s.failed = true;
+    s.error = e.what();
+  }
+  return true;
+}
+
+std::string pfpd_handler::parse_uncached(const std::vector< std::string > & words, const boost::posix_time::ptime & deadline,
+                                         parse_stats * work, bool & partial, const std::vector< bool > * wanted,
+                                         tree_format format)
+{
+  try
+  {
+    // befirst, some words.  no workspace yet: we only hold one while we're in the chart
+    boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+    std::vector< std::vector< state_score_t > > sentence_f;
+    node result;
+    for (std::vector< std::string >::const_iterator it = words.begin(); it != words.end(); ++it)
+    {
+      sentence_f.push_back(std::vector< state_score_t >());
+      lexicon_.chart_score(*it, std::back_inserter(sentence_f.back()));
+    }
+    // add the boundary symbol
+    sentence_f.push_back( std::vector< state_score_t >(1, state_score_t(consts::boundary_state, 0.0f)));
+    stats_.record(server_stats::lexicon, words.size(), server_stats::elapsed_us(start));
+    // now parse!  a sentence too long for our workspaces is parsed a piece at a time if it can be split,
+    // the pieces spread over the workers, and joined back together
+    parse_stats counted;
+    chart_t outcome = parsed;
+    std::vector< size_t > ends;
+    std::vector< span > spans;
+    if (sentence_f.size() <= workspaces_.longest() || !splitter_->split(words, ends))
+      outcome = chart(sentence_f, deadline, work ? &counted : 0, result, wanted, &spans);
+    else
+    {
+      std::vector< segment > segments(ends.size());
+      for (size_t i = 0, begin = 0; i != ends.size(); begin = ends[i++])
+      {
+        segments[i].sentence_f.assign(sentence_f.begin() + begin, sentence_f.begin() + ends[i]);
+        segments[i].sentence_f.push_back(sentence_f.back());
+      }
+      // as many at a time as there are workspaces to chart them in
+      jobs_.for_each(segments.size(), boost::bind(&pfpd_handler::chart_segment, this, boost::ref(segments),
+                                                   boost::cref(deadline), work != 0, _1), threads_);
+      // the whole sentence fares as its worst piece did
+      std::vector< node > results;
+      for (std::vector< segment >::iterator it = segments.begin(); it != segments.end(); ++it)
+      {
+        counted += it->counted;
+        if (it->failed)
+          throw std::runtime_error(it->error);
+        outcome = std::max(outcome, it->outcome);
+        results.push_back(it->result);
+      }
+      splitter_->join(results, result);
+      if (wanted)
+        tree_spans(result, *wanted, spans);
+    }
+    if (work)
+    {
+      stats_.record(counted);
+      *work += counted;
+    }
+    if (outcome != parsed)
+    {
+      stats_.count(server_stats::fallbacks);
+      stats_.count(outcome == timed_out ? server_stats::timeouts : server_stats::parse_failures);
+      partial = outcome == timed_out;
+    }
+    // stitch together the results
+    start = boost::posix_time::microsec_clock::universal_time();
+    std::string out;
+    if (wanted)
+    {
+      std::ostringstream oss;
+      stitch_spans(oss, spans, states_);
+      out = oss.str();
+    }
+    else
+    {
+      // about what the brackets take, so the string only grows once
+      out.reserve(words.size() * 24);
+      write_tree(format, out, result, words, states_);
+    }
+    stats_.record(server_stats::stitch, words.size(), server_stats::elapsed_us(start));
+    return out;
+  }
+  catch (const std::runtime_error &)
+  {
+    stats_.count(server_stats::parse_errors);
+    throw;
+  }
+}
+
+std::string pfpd_handler::parse_document(const std::string & text, const boost::posix_time::ptime & deadline, parse_stats * work,
+                                         tree_format format)
+{
+  std::string out;
+  document_tokenizer doc(tokenizer_, text.data(), text.data() + text.size());
+  boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+  for (std::vector< std::string > words; doc.next(words); start = boost::posix_time::microsec_clock::universal_time())
+  {
+    stats_.record(server_stats::tokenize, words.size(), server_stats::elapsed_us(start));
+    // once the deadline's passed, the sentences left go unparsed
+    if (start >= deadline)
+      break;
+    // one bad sentence shouldn't sink the whole document
+    std::string result;
+    try { result = parse_words(words, deadline, work, format); }
+    catch (const std::runtime_error & e) { std::cerr << "error: " << e.what() << std::endl; }
+    append_result(out, result, format);
+  }
+  return out;
+}
+
+const char * pfpd_handler::content_type(tree_format format, bool many)
+{
+  switch (format)
+  {
+  case json_format:   return many ? "application/x-ndjson" : "application/json";
+  case binary_format: return "application/octet-stream";
+  default:            return "text/plain";
+  }
+}
+
+void pfpd_handler::append_result(std::string & out, const std::string & result, tree_format format)
+{
+  if (format == binary_format)
+    append_varint(out, result.size());
+  out.append(result.empty() && format == json_format ? "null" : result);
+  if (format != binary_format)
+    out.append(1, '\n');
+}
+
+std::string pfpd_handler::parse_batch(const std::string & content, const boost::posix_time::ptime & deadline, parse_stats * work,
+                                      const std::vector< bool > * wanted, tree_format format)
+{
+  std::vector< std::string > lines;
+  for (size_t begin = 0, end; begin < content.size(); begin = end + 1)
+  {
+    end = content.find('\n', begin);
+    if (end == std::string::npos)
+      end = content.size();
+    lines.push_back(content.substr(begin, end - begin));
+  }
+  // spread the lines over as many workers as there are, this one included.  each takes the next
+  // unparsed line, and writes its result and its work back in place
+  std::vector< std::string > results(lines.size());
+  std::vector< parse_stats > counted(work ? lines.size() : 0);
+  jobs_.for_each(lines.size(), boost::bind(&pfpd_handler::parse_batch_line, this, boost::cref(lines), boost::ref(results),
+                                           work ? &counted : 0, boost::cref(deadline), wanted, format, _1),
+                 workers_per_workspace * threads_);
+  for (std::vector< parse_stats >::const_iterator it = counted.begin(); it != counted.end(); ++it)
+    *work += *it;
+
+  std::string out;
+  for (std::vector< std::string >::const_iterator it = results.begin(); it != results.end(); ++it)
+    append_result(out, *it, wanted ? bracket_format : format);
+  return out;
+}
+
+bool pfpd_handler::parse_batch_line(const std::vector< std::string > & lines, std::vector< std::string > & results,
+                                    std::vector< parse_stats > * counted, const boost::posix_time::ptime & deadline,
+                                    const std::vector< bool > * wanted, tree_format format, size_t i)
+{
+  // once the deadline's passed, the lines left go unparsed
+  if (boost::posix_time::microsec_clock::universal_time() >= deadline)
+    return false;
+  const std::string & line = lines[i];
+  std::vector< std::string > words;
+  if (!line.empty() && line[0] == '[')
+  {
+    if (!json_string_array(line, words))
+    {
+      std::cerr << "error: malformed token array on line " << i + 1 << std::endl;
+      return true;
+    }
+  }
+  else
+  {
+    boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+    tokenizer_.tokenize(line, words);
+    stats_.record(server_stats::tokenize, words.size(), server_stats::elapsed_us(start));
+  }
+  if (words.empty())
+    return true;
+  // one bad sentence shouldn't sink the whole batch
+  parse_stats * work = counted ? &(*counted)[i] : 0;
+  try
+  {
+    results[i] = wanted ? span_words(words, *wanted, deadline, work) : parse_words(words, deadline, work, format);
+  }
+  catch (const std::runtime_error & e) { std::cerr << "error: " << e.what() << std::endl; }
+  return true;
+}
+
+// read four hex digits of a json \u escape
+static bool json_hex4(std::string::const_iterator & it, std::string::const_iterator end, unsigned int & cp)
+{
+  cp = 0;
+  for (int n = 0; n != 4; ++n, ++it)
+  {
+    if (it == end || !isxdigit(static_cast<unsigned char>(*it)))
+      return false;
+    cp = cp * 16 + (isdigit(static_cast<unsigned char>(*it)) ? *it - '0' : tolower(*it) - 'a' + 10);
+  }
+  return true;
+}
+
+static void append_utf8(std::string & s, unsigned int cp)
+{
+  if (cp < 0x80)
+    s += static_cast<char>(cp);
+  else if (cp < 0x800)
+  {
+    s += static_cast<char>(0xc0 | (cp >> 6));
+    s += static_cast<char>(0x80 | (cp & 0x3f));
+  }
+  else if (cp < 0x10000)
+  {
+    s += static_cast<char>(0xe0 | (cp >> 12));
+    s += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+    s += static_cast<char>(0x80 | (cp & 0x3f));
+  }
+  else
+  {
+    s += static_cast<char>(0xf0 | (cp >> 18));
+    s += static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+    s += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+    s += static_cast<char>(0x80 | (cp & 0x3f));
+  }
+}
+
+// skip whitespace, returning false at the end of input
+static bool json_skip_ws(std::string::const_iterator & it, std::string::const_iterator end)
+{
+  while (it != end && isspace(static_cast<unsigned char>(*it)))
+    ++it;
+  return it != end;
+}
+
+bool pfpd_handler::json_string_array(const std::string & in, std::vector< std::string > & out)
+{
+  std::string::const_iterator it = in.begin(), end = in.end();
+  if (!json_skip_ws(it, end) || *it++ != '[' || !json_skip_ws(it, end))
+    return false;
+  if (*it == ']')
+    return json_skip_ws(++it, end) == false;
+  for (;;)
+  {
+    if (!json_skip_ws(it, end) || *it++ != '"')
+      return false;
+    out.push_back(std::string());
+    std::string & s = out.back();
+    for (;;)
+    {
+      if (it == end)
+        return false;
+      char c = *it++;
+      if (c == '"')
+        break;
+      if (c != '\\')
+      {
+        s += c;
+        continue;
+      }
+      if (it == end)
+        return false;
+      switch (c = *it++)
+      {
+      case 'b': s += '\b'; break;
+      case 'f': s += '\f'; break;
+      case 'n': s += '\n'; break;
+      case 'r': s += '\r'; break;
+      case 't': s += '\t'; break;
+      case 'u':
+        {
+          unsigned int cp, lo;
+          if (!json_hex4(it, end, cp))
+            return false;
+          // a high surrogate followed by a low one makes a single code point
+          std::string::const_iterator jt = it;
+          if (cp >= 0xd800 && cp < 0xdc00 && end - jt >= 2 && jt[0] == '\\' && jt[1] == 'u'
+              && json_hex4(jt += 2, end, lo) && lo >= 0xdc00 && lo < 0xe000)
+          {
+            cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+            it = jt;
+          }
+          append_utf8(s, cp);
+        }
+        break;
+      default: s += c; break; // \" \\ \/
+      }
+    }
+    if (!json_skip_ws(it, end))
+      return false;
+    char c = *it++;
+    if (c == ']')
+      return json_skip_ws(it, end) == false; // nothing may follow the array
+    if (c != ',')
+      return false;
+  }
+}
@@ -68,33 +68,66 @@ void pypfp::init(size_t sentence_length /*= 45*/, const std::string & data_dir /
   pworkspace_.reset(new workspace(sentence_length, states_.size()));
 }
 
-std::string pypfp::_parse_tokens(const std::vector<std::string>& words)
+boost::posix_time::ptime pypfp::_deadline(size_t timeout_ms)
+{
+  if (timeout_ms == 0)
+    return boost::posix_time::ptime(boost::posix_time::pos_infin);
+  return boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(timeout_ms);
+}
+
+template<class Workspace>
+void pypfp::_chart(const std::vector< std::vector< state_score_t > > & sentence_f, Workspace & ws, const boost::posix_time::ptime & deadline,
+                   node & result, const std::vector<bool> * wanted, std::vector<span> & spans)
+{
+  // if there's no parse, the best fragments in the chart will have to do
+  if (!pcfg_.fill(sentence_f, ws, deadline))
+  {
+    pcfg_.fragments(sentence_f, ws, result);
+    if (wanted)
+      tree_spans(result, *wanted, spans);
+  }
+  else if (wanted)
+    pcfg_.spans(sentence_f, ws, *wanted, spans);
+  else
+    pcfg_.backtrace(sentence_f, ws, result);
+}
+
+void pypfp::_chart_tokens(const std::vector<std::string>& words, const boost::posix_time::ptime & deadline, node & result,
+                          const std::vector<bool> * wanted, std::vector<span> & spans)
 {
-  std::vector< std::pair< state_t, float > > state_weight;
   std::vector< std::vector< state_score_t > > sentence_f;
-  node result;
 
   for (std::vector< std::string >::const_iterator it = words.begin(); it != words.end(); ++it)
   {
-    state_weight.clear(); lexicon_.score(*it, std::back_inserter(state_weight));
-    sentence_f.push_back(std::vector< state_score_t >(state_weight.size()));
-    // scale by score_resolution in case we are downcasting our weights
-    for (size_t i = 0; i != state_weight.size(); ++i)
-      sentence_f.back()[i] = state_score_t(state_weight[i].first, state_weight[i].second * consts::score_resolution);
+    sentence_f.push_back(std::vector< state_score_t >());
+    lexicon_.chart_score(*it, std::back_inserter(sentence_f.back()));
   }
   // add the boundary symbol
   sentence_f.push_back( std::vector< state_score_t >(1, state_score_t(consts::boundary_state, 0.0f)));
-  // and parse!
-  if (!pcfg_.parse(sentence_f, *pworkspace_, result))
-    return "";
+  // and parse!  a sentence too long for our workspace gets a sparse one of its own, which only keeps the scores it fills
+  if (sentence_f.size() <= pworkspace_->words || sentence_f.size() > consts::max_sentence_size)
+    _chart(sentence_f, *pworkspace_, deadline, result, wanted, spans);
+  else
+  {
+    sparse_workspace pw(static_cast<pos_t>(sentence_f.size()), states_.size());
+    _chart(sentence_f, pw, deadline, result, wanted, spans);
+  }
+}
+
+std::string pypfp::_parse_tokens(const std::vector<std::string>& words, const boost::posix_time::ptime & deadline)
+{
+  node result;
+  std::vector<span> spans;
+  _chart_tokens(words, deadline, result, 0, spans);
   // stitch together the results
   std::ostringstream oss;
   stitch(oss, result, words.begin(), states_);
   return oss.str();   
 }
 
-std::string pypfp::parse_tokens(const boost::python::list& words)
+std::string pypfp::parse_tokens(const boost::python::list& words, size_t timeout_ms)
 {
+  boost::posix_time::ptime deadline = _deadline(timeout_ms);
   std::vector<std::string> words_vec;
   size_t len = boost::python::len(words);
   
@@ -104,15 +137,64 @@ std::string pypfp::parse_tokens(const boost::python::list& words)
   for (size_t i = 0; i != len; ++i)
     words_vec.push_back(boost::python::extract<std::string>(words[i]));
 
-   return _parse_tokens(words_vec);
+   return _parse_tokens(words_vec, deadline);
 }
 
-std::string pypfp::parse(const std::string & sentence)
+std::string pypfp::parse(const std::string & sentence, size_t timeout_ms)
 {
+  boost::posix_time::ptime deadline = _deadline(timeout_ms);
   // now some words
   std::vector< std::string > words;
   tokenizer_.tokenize(sentence, words);
-  return _parse_tokens(words);
+  return _parse_tokens(words, deadline);
+}
+
+boost::python::list pypfp::parse_document(const std::string & text, size_t timeout_ms)
+{
+  boost::posix_time::ptime deadline = _deadline(timeout_ms);
+  boost::python::list parses;
+  document_tokenizer doc(tokenizer_, text.data(), text.data() + text.size());
+  for (std::vector<std::string> words; doc.next(words); )
+    parses.append(_parse_tokens(words, deadline));
+  return parses;
+}
+
+boost::python::list pypfp::parse_spans(const std::string & sentence, const boost::python::list & labels, size_t timeout_ms)
+{
+  boost::posix_time::ptime deadline = _deadline(timeout_ms);
+  std::vector<std::string> categories, words;
+  for (size_t i = 0, len = boost::python::len(labels); i != len; ++i)
+    categories.push_back(boost::python::extract<std::string>(labels[i]));
+  std::vector<bool> wanted;
+  states_.select(categories, wanted);
+  tokenizer_.tokenize(sentence, words);
+  node result;
+  std::vector<span> spans;
+  _chart_tokens(words, deadline, result, &wanted, spans);
+  boost::python::list out;
+  for (std::vector<span>::const_iterator it = spans.begin(); it != spans.end(); ++it)
+    out.append(boost::python::make_tuple(states_.basic_category(it->state), static_cast<int>(it->begin), static_cast<int>(it->end)));
+  return out;
+}
+
+boost::python::list pypfp::tag(const std::string & sentence)
+{
+  if (!ptagger_)
+  {
+    ptagger_.reset(new tagger(states_, lexicon_, ug_, bg_));
+    ptagger_->init();
+  }
+  std::vector< std::string > words;
+  std::vector< state_t > tags;
+  tokenizer_.tokenize(sentence, words);
+  ptagger_->tag(words, tags);
+  boost::python::list tagged;
+  for (size_t i = 0; i != words.size(); ++i)
+  {
+    const std::string & category = states_.basic_category(tags[i]);
+    tagged.append(boost::python::make_tuple(words[i], category.empty() ? states_[tags[i]].tag : category));
+  }
+  return tagged;
 }
 
 BOOST_PYTHON_MODULE(pfp)
@@ -120,9 +202,18 @@ BOOST_PYTHON_MODULE(pfp)
     class_<pypfp, boost::noncopyable>("Parser", init<>())
           .def(init<size_t>(boost::python::args("max_sentence_len")))
           .def(init<size_t, const std::string &>(boost::python::args("max_sentence_len", "data_dir")))
-      .def("parse", &pypfp::parse, boost::python::args("self", "sentence"),
-            "Will parse the given sentence")
-      .def("parse_tokens", &pypfp::parse_tokens, boost::python::args("self", "tokens"),
-            "Will parse the give tokens list")
+      .def("parse", &pypfp::parse, (arg("self"), arg("sentence"), arg("timeout_ms") = 0),
+            "Will parse the given sentence, giving up after timeout_ms if it's nonzero")
+      .def("parse_tokens", &pypfp::parse_tokens, (arg("self"), arg("tokens"), arg("timeout_ms") = 0),
+            "Will parse the give tokens list, giving up after timeout_ms if it's nonzero")
+      .def("parse_document", &pypfp::parse_document, (arg("self"), arg("text"), arg("timeout_ms") = 0),
+            "Will split the given text into sentences and parse each, returning a list of parses.  "
+            "Gives up on the whole document after timeout_ms if it's nonzero")
+      .def("parse_spans", &pypfp::parse_spans, (arg("self"), arg("sentence"), arg("labels") = boost::python::list(), arg("timeout_ms") = 0),
+            "Will parse the given sentence and return just the (label, begin, end) spans of the constituents "
+            "whose labels are given, such as [\"NP\", \"VP\"], or of every constituent if none are")
+      .def("tag", &pypfp::tag, (arg("self"), arg("sentence")),
+            "Will tag each word of the given sentence with its part of speech, without parsing it.  "
+            "Returns a list of (word, tag) tuples")
     ;
 }
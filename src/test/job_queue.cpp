@@ -0,0 +1,170 @@
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/test/test_tools.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include <pfpd/job_queue.hpp>
+
+#include "latch.hpp"
+
+using namespace com::wavii::pfp;
+
+static void hold(latch * gate) { gate->wait(); }
+
+static void record(std::vector< int > * order, int job) { order->push_back(job); }
+
+static void fail() { throw std::runtime_error("out of memory"); }
+
+// mark an item of a for_each done, stopping after the item numbered last
+static bool mark(std::vector< int > * done, size_t last, size_t i)
+{
+  ++(*done)[i];
+  return i != last;
+}
+
+// mark an item of a for_each done, failing on the item numbered bad
+static bool mark_or_fail(std::vector< int > * done, size_t bad, size_t i)
+{
+  ++(*done)[i];
+  if (i == bad)
+    throw std::runtime_error("out of memory");
+  return true;
+}
+
+// start a single worker and tie it up, so jobs queue behind it until gate opens
+static void occupy(job_queue & jobs, latch & gate, double aging)
+{
+  jobs.start(1, 8, aging);
+  BOOST_REQUIRE( jobs.push(boost::bind(hold, &gate)) );
+  while (jobs.size() != 0)
+    boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+}
+
+// queue jobs costing 30, 10, and 20 a millisecond apart, and return the order they ran in
+static std::vector< int > run_order(double aging)
+{
+  job_queue jobs;
+  latch gate;
+  std::vector< int > order;
+  occupy(jobs, gate, aging);
+  int costs[] = { 30, 10, 20 };
+  for (int i = 0; i != 3; ++i)
+  {
+    BOOST_CHECK( jobs.push(boost::bind(record, &order, costs[i]), costs[i]) );
+    boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+  }
+  gate.release();
+  jobs.stop();
+  return order;
+}
+
+BOOST_AUTO_TEST_SUITE( job_queue_test )
+
+BOOST_AUTO_TEST_CASE( test_job_queue_bound )
+{
+  // with no workers, nothing leaves the queue
+  job_queue jobs;
+  std::vector< int > order;
+  jobs.start(0, 2);
+  BOOST_CHECK( jobs.push(boost::bind(record, &order, 1)) );
+  BOOST_CHECK( jobs.push(boost::bind(record, &order, 2)) );
+  BOOST_CHECK( !jobs.push(boost::bind(record, &order, 3)) );
+  BOOST_CHECK_EQUAL( jobs.size(), 2 );
+  jobs.stop();
+  // and once it's stopping it takes nothing more
+  BOOST_CHECK( !jobs.push(boost::bind(record, &order, 4)) );
+  BOOST_CHECK( order.empty() );
+}
+
+BOOST_AUTO_TEST_CASE( test_job_queue_priority )
+{
+  // aging so slowly that waiting makes no difference, the cheapest job runs first
+  std::vector< int > order = run_order(1e-9);
+  BOOST_REQUIRE_EQUAL( order.size(), 3 );
+  BOOST_CHECK_EQUAL( order[0], 10 );
+  BOOST_CHECK_EQUAL( order[1], 20 );
+  BOOST_CHECK_EQUAL( order[2], 30 );
+}
+
+BOOST_AUTO_TEST_CASE( test_job_queue_aging )
+{
+  // aging so fast that a millisecond's wait outweighs any cost, first come is first served
+  std::vector< int > order = run_order(1e3);
+  BOOST_REQUIRE_EQUAL( order.size(), 3 );
+  BOOST_CHECK_EQUAL( order[0], 30 );
+  BOOST_CHECK_EQUAL( order[1], 10 );
+  BOOST_CHECK_EQUAL( order[2], 20 );
+}
+
+BOOST_AUTO_TEST_CASE( test_job_queue_throws )
+{
+  // a job that throws leaves its worker to run the next
+  job_queue jobs;
+  latch gate;
+  std::vector< int > order;
+  occupy(jobs, gate, 1.0);
+  BOOST_CHECK( jobs.push(fail) );
+  BOOST_CHECK( jobs.push(boost::bind(record, &order, 1)) );
+  gate.release();
+  jobs.stop();
+  BOOST_REQUIRE_EQUAL( order.size(), 1 );
+  BOOST_CHECK_EQUAL( order[0], 1 );
+}
+
+BOOST_AUTO_TEST_CASE( test_job_queue_for_each )
+{
+  job_queue jobs;
+  jobs.start(3, 8);
+  std::vector< int > done(100);
+  jobs.for_each(done.size(), boost::bind(mark, &done, done.size(), _1), 4);
+  // every item ran exactly once
+  BOOST_CHECK_EQUAL( std::count(done.begin(), done.end(), 1), 100 );
+  // and the helpers didn't outlast it
+  jobs.stop();
+  BOOST_CHECK_EQUAL( std::count(done.begin(), done.end(), 1), 100 );
+}
+
+BOOST_AUTO_TEST_CASE( test_job_queue_for_each_stops )
+{
+  // on this thread alone, the items run in order, and stop at the one that says so
+  job_queue jobs;
+  jobs.start(1, 8);
+  std::vector< int > done(10);
+  jobs.for_each(done.size(), boost::bind(mark, &done, 5, _1), 1);
+  BOOST_CHECK_EQUAL( std::count(done.begin(), done.begin() + 6, 1), 6 );
+  BOOST_CHECK_EQUAL( std::count(done.begin() + 6, done.end(), 0), 4 );
+}
+
+BOOST_AUTO_TEST_CASE( test_job_queue_for_each_queued )
+{
+  // with no worker to run its helper, this thread does everything itself rather than wait on the queue
+  job_queue jobs;
+  jobs.start(0, 1);
+  std::vector< int > done(10);
+  jobs.for_each(done.size(), boost::bind(mark, &done, done.size(), _1), 2);
+  BOOST_CHECK_EQUAL( std::count(done.begin(), done.end(), 1), 10 );
+  BOOST_CHECK_EQUAL( jobs.size(), 1 );
+  // and with the queue full, it doesn't queue one at all
+  std::fill(done.begin(), done.end(), 0);
+  jobs.for_each(done.size(), boost::bind(mark, &done, done.size(), _1), 2);
+  BOOST_CHECK_EQUAL( std::count(done.begin(), done.end(), 1), 10 );
+}
+
+BOOST_AUTO_TEST_CASE( test_job_queue_for_each_throws )
+{
+  // an item that throws stops the rest, and the caller hears of it
+  job_queue jobs;
+  jobs.start(1, 8);
+  std::vector< int > done(10);
+  BOOST_CHECK_THROW( jobs.for_each(done.size(), boost::bind(mark_or_fail, &done, 3, _1), 1), std::runtime_error );
+  BOOST_CHECK_EQUAL( std::count(done.begin(), done.begin() + 4, 1), 4 );
+  BOOST_CHECK_EQUAL( std::count(done.begin() + 4, done.end(), 0), 6 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,31 @@
+#ifndef __TEST_LATCH_HPP__
+#define __TEST_LATCH_HPP__
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+
+// holds threads back until it's opened
+struct latch
+{
+  boost::mutex mutex;
+  boost::condition cond;
+  bool open;
+
+  latch() : open(false) {}
+
+  void wait()
+  {
+    boost::mutex::scoped_lock lock(mutex);
+    while (!open)
+      cond.wait(lock);
+  }
+
+  void release()
+  {
+    boost::mutex::scoped_lock lock(mutex);
+    open = true;
+    cond.notify_all();
+  }
+};
+
+#endif // __TEST_LATCH_HPP__
@@ -73,4 +73,34 @@ BOOST_FIXTURE_TEST_CASE( test_phalanxes, lexicon_test_fixture )
 
 }
 
+// precomputed chart scores agree with the float scores, downcast
+BOOST_FIXTURE_TEST_CASE( test_chart_score, lexicon_test_fixture )
+{
+  const char * words[] = { "", "The", "promotional", "phalanxes", "monkeys" };
+  for (size_t w = 0; w != sizeof(words) / sizeof(const char *); ++w)
+  {
+    std::vector< state_score_t > chart;
+    scores.clear(); lex.score(words[w], std::back_inserter(scores));
+    lex.chart_score(words[w], std::back_inserter(chart));
+    BOOST_REQUIRE_EQUAL( chart.size(), scores.size() );
+    for (size_t i = 0; i != chart.size(); ++i)
+    {
+      BOOST_CHECK_EQUAL( chart[i].state, scores[i].first );
+      BOOST_CHECK_EQUAL( chart[i].score, static_cast<score_t>(scores[i].second * consts::score_resolution) );
+    }
+  }
+}
+
+BOOST_FIXTURE_TEST_CASE( test_ambiguity, lexicon_test_fixture )
+{
+  // never less than the states we'd actually hand the parser
+  const char * words[] = { "", "The", "promotional", "phalanxes", "monkeys" };
+  for (size_t w = 0; w != sizeof(words) / sizeof(const char *); ++w)
+  {
+    std::vector< state_score_t > chart;
+    lex.chart_score(words[w], std::back_inserter(chart));
+    BOOST_CHECK_GE( lex.ambiguity(words[w]), chart.size() );
+  }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
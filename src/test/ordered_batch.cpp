@@ -0,0 +1,152 @@
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/test/test_tools.hpp>
+
+#include <boost/ref.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include <pfpc/ordered_batch.hpp>
+
+using namespace com::wavii::pfp;
+
+typedef ordered_batch< std::string, std::string > string_batch;
+
+// pushes an input on a thread of its own, saying when it's got in
+struct pusher
+{
+  string_batch &  batch;
+  std::string     in;
+  boost::mutex    mutex;
+  bool            pushed;
+
+  pusher(string_batch & batch, const std::string & in) : batch(batch), in(in), pushed(false) {}
+
+  void operator()()
+  {
+    batch.push(in);
+    boost::mutex::scoped_lock lock(mutex);
+    pushed = true;
+  }
+
+  bool wait_a_while()
+  {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+    boost::mutex::scoped_lock lock(mutex);
+    return pushed;
+  }
+};
+
+BOOST_AUTO_TEST_SUITE( ordered_batch_test )
+
+BOOST_AUTO_TEST_CASE( test_ordered_batch_order )
+{
+  string_batch batch(8);
+  for (int i = 0; i != 5; ++i)
+  {
+    std::string in = boost::lexical_cast< std::string >(i);
+    batch.push(in);
+    // the input's swapped in, not copied
+    BOOST_CHECK( in.empty() );
+  }
+  batch.close();
+  size_t seqs[5];
+  std::string in, out;
+  for (int i = 0; i != 5; ++i)
+  {
+    BOOST_REQUIRE( batch.pop(seqs[i], in) );
+    BOOST_CHECK_EQUAL( seqs[i], i );
+    BOOST_CHECK_EQUAL( in, boost::lexical_cast< std::string >(i) );
+  }
+  BOOST_CHECK( !batch.pop(seqs[0], in) );
+  // finished last first, nothing can be written until the first is done
+  for (int i = 4; i != 1; --i)
+  {
+    out = "parse " + boost::lexical_cast< std::string >(i);
+    batch.finish(seqs[i], out);
+  }
+  BOOST_CHECK( !batch.try_next(out) );
+  out = "parse 0";
+  batch.finish(seqs[0], out);
+  BOOST_CHECK( batch.try_next(out) );
+  BOOST_CHECK_EQUAL( out, "parse 0" );
+  BOOST_CHECK( !batch.try_next(out) );
+  out = "parse 1";
+  batch.finish(seqs[1], out);
+  // then the rest come out in the order they were read
+  for (int i = 1; i != 5; ++i)
+  {
+    BOOST_REQUIRE( batch.next(out) );
+    BOOST_CHECK_EQUAL( out, "parse " + boost::lexical_cast< std::string >(i) );
+  }
+  BOOST_CHECK( !batch.next(out) );
+}
+
+BOOST_AUTO_TEST_CASE( test_ordered_batch_window )
+{
+  string_batch batch(2);
+  std::string in = "a";
+  batch.push(in);
+  in = "b";
+  batch.push(in);
+  // the reader's a window ahead of the writer, so it waits
+  pusher third(batch, "c");
+  boost::thread pushing(boost::ref(third));
+  BOOST_CHECK( !third.wait_a_while() );
+  // taking and finishing an input doesn't make room: writing its result does
+  size_t seq;
+  std::string out = "parse a";
+  BOOST_REQUIRE( batch.pop(seq, in) );
+  batch.finish(seq, out);
+  BOOST_CHECK( !third.wait_a_while() );
+  BOOST_REQUIRE( batch.next(out) );
+  BOOST_CHECK_EQUAL( out, "parse a" );
+  BOOST_CHECK( third.wait_a_while() );
+  pushing.join();
+  BOOST_REQUIRE( batch.pop(seq, in) );
+  BOOST_CHECK_EQUAL( in, "b" );
+  BOOST_REQUIRE( batch.pop(seq, in) );
+  BOOST_CHECK_EQUAL( seq, 2 );
+  BOOST_CHECK_EQUAL( in, "c" );
+}
+
+BOOST_AUTO_TEST_CASE( test_ordered_batch_close )
+{
+  // closed without any inputs, there's nothing to work on or write
+  string_batch batch(2);
+  batch.close();
+  size_t seq;
+  std::string in, out;
+  BOOST_CHECK( !batch.pop(seq, in) );
+  BOOST_CHECK( !batch.try_next(out) );
+  BOOST_CHECK( !batch.next(out) );
+}
+
+BOOST_AUTO_TEST_CASE( test_reorder_buffer )
+{
+  // numbered results handed back out of order, as pfp_batch's chunks are
+  reorder_buffer< std::string > results(2);
+  results.close(3);
+  std::string out = "parse 1";
+  results.finish(1, out);
+  BOOST_CHECK( !results.try_next(out) );
+  out = "parse 0";
+  results.finish(0, out);
+  // work on result 2 can start once result 0's written
+  BOOST_REQUIRE( results.next(out) );
+  BOOST_CHECK_EQUAL( out, "parse 0" );
+  results.wait_room(2);
+  out = "parse 2";
+  results.finish(2, out);
+  BOOST_REQUIRE( results.next(out) );
+  BOOST_CHECK_EQUAL( out, "parse 1" );
+  BOOST_REQUIRE( results.next(out) );
+  BOOST_CHECK_EQUAL( out, "parse 2" );
+  // and there are no more than it was told
+  BOOST_CHECK( !results.next(out) );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
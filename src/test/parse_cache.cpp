@@ -0,0 +1,134 @@
+#include <string>
+#include <sstream>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/test/test_tools.hpp>
+
+#include <pfpd/parse_cache.hpp>
+
+using namespace com::wavii::pfp;
+
+// read one of the cache's metrics back out of what it writes for /stats
+static size_t metric(parse_cache & cache, const std::string & name)
+{
+  std::ostringstream oss;
+  cache.write(oss);
+  std::istringstream iss(oss.str());
+  std::string line;
+  while (std::getline(iss, line))
+  {
+    if (line.compare(0, name.size() + 1, name + " ") == 0)
+      return boost::lexical_cast< size_t >(line.substr(name.size() + 1));
+  }
+  BOOST_FAIL("no metric " + name);
+  return 0;
+}
+
+// a one letter key and parse costs 2 + 1 + 96 bytes
+static const size_t entry = 99;
+
+BOOST_AUTO_TEST_SUITE( parse_cache_test )
+
+BOOST_AUTO_TEST_CASE( test_parse_cache_lru )
+{
+  parse_cache cache(1);
+  cache.init(3 * entry);
+  std::string value;
+  cache.put("a", "1");
+  cache.put("b", "2");
+  cache.put("c", "3");
+  BOOST_CHECK_EQUAL( metric(cache, "pfpd_cache_entries"), 3 );
+  BOOST_CHECK_EQUAL( metric(cache, "pfpd_cache_bytes"), 3 * entry );
+  // looking up a makes b the least recently used, so d pushes it out
+  BOOST_CHECK( cache.get("a", value) );
+  cache.put("d", "4");
+  BOOST_CHECK( !cache.get("b", value) );
+  BOOST_CHECK( cache.get("a", value) );
+  BOOST_CHECK_EQUAL( value, "1" );
+  BOOST_CHECK( cache.get("c", value) );
+  BOOST_CHECK( cache.get("d", value) );
+  BOOST_CHECK_EQUAL( metric(cache, "pfpd_cache_entries"), 3 );
+  BOOST_CHECK_EQUAL( metric(cache, "pfpd_cache_evictions_total"), 1 );
+  BOOST_CHECK_EQUAL( metric(cache, "pfpd_cache_inserts_total"), 4 );
+  // a parse bigger than the budget would push everything out, so it's never kept
+  cache.put("e", std::string(3 * entry, 'x'));
+  BOOST_CHECK( !cache.get("e", value) );
+  BOOST_CHECK_EQUAL( metric(cache, "pfpd_cache_entries"), 3 );
+}
+
+BOOST_AUTO_TEST_CASE( test_parse_cache_shards )
+{
+  // the budget is split evenly between the shards, so each holds just one entry
+  parse_cache cache(4);
+  cache.init(4 * entry);
+  BOOST_CHECK_EQUAL( metric(cache, "pfpd_cache_max_bytes"), 4 * entry );
+  for (char c = 'a'; c <= 'z'; ++c)
+    cache.put(std::string(1, c), "1");
+  BOOST_CHECK( metric(cache, "pfpd_cache_entries") <= 4 );
+  BOOST_CHECK( metric(cache, "pfpd_cache_bytes") <= 4 * entry );
+  BOOST_CHECK_EQUAL( metric(cache, "pfpd_cache_inserts_total"), 26 );
+  BOOST_CHECK_EQUAL( metric(cache, "pfpd_cache_inserts_total") - metric(cache, "pfpd_cache_evictions_total"),
+                     metric(cache, "pfpd_cache_entries") );
+  // the last key put is always still in its shard
+  std::string value;
+  BOOST_CHECK( cache.get("z", value) );
+  // and an entry that fits the whole budget but not a shard isn't kept
+  cache.put("A", "12");
+  BOOST_CHECK( !cache.get("A", value) );
+}
+
+BOOST_AUTO_TEST_CASE( test_parse_cache_restore )
+{
+  parse_cache cache(1);
+  cache.init(3 * entry);
+  std::string value;
+  cache.put("a", "1");
+  cache.put("b", "2");
+  // storing a again keeps the first parse, and only freshens it
+  cache.put("a", "9");
+  BOOST_CHECK_EQUAL( metric(cache, "pfpd_cache_inserts_total"), 2 );
+  BOOST_CHECK_EQUAL( metric(cache, "pfpd_cache_bytes"), 2 * entry );
+  cache.put("c", "3");
+  cache.put("d", "4");
+  BOOST_CHECK( !cache.get("b", value) );
+  BOOST_CHECK( cache.get("a", value) );
+  BOOST_CHECK_EQUAL( value, "1" );
+}
+
+BOOST_AUTO_TEST_CASE( test_parse_cache_clear )
+{
+  parse_cache cache(2);
+  cache.init(10 * entry);
+  std::string value;
+  cache.put("a", "1");
+  cache.put("b", "2");
+  BOOST_CHECK( cache.get("a", value) );
+  BOOST_CHECK( !cache.get("c", value) );
+  // a second look doesn't count
+  BOOST_CHECK( !cache.get("c", value, false) );
+  cache.clear();
+  BOOST_CHECK( !cache.get("a", value) );
+  BOOST_CHECK( !cache.get("b", value) );
+  BOOST_CHECK_EQUAL( metric(cache, "pfpd_cache_entries"), 0 );
+  BOOST_CHECK_EQUAL( metric(cache, "pfpd_cache_bytes"), 0 );
+  // the counters outlive what they counted
+  BOOST_CHECK_EQUAL( metric(cache, "pfpd_cache_inserts_total"), 2 );
+  BOOST_CHECK_EQUAL( metric(cache, "pfpd_cache_lookups_total{result=\"hit\"}"), 1 );
+  BOOST_CHECK_EQUAL( metric(cache, "pfpd_cache_lookups_total{result=\"miss\"}"), 3 );
+  cache.put("a", "1");
+  BOOST_CHECK( cache.get("a", value) );
+}
+
+BOOST_AUTO_TEST_CASE( test_parse_cache_disabled )
+{
+  parse_cache cache;
+  cache.init(0);
+  BOOST_CHECK( !cache.enabled() );
+  std::string value;
+  cache.put("a", "1");
+  BOOST_CHECK( !cache.get("a", value) );
+  BOOST_CHECK_EQUAL( metric(cache, "pfpd_cache_inserts_total"), 0 );
+  BOOST_CHECK_EQUAL( metric(cache, "pfpd_cache_lookups_total{result=\"miss\"}"), 0 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
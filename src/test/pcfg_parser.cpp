@@ -14,16 +14,18 @@
 
 using namespace com::wavii::pfp;
 
-BOOST_AUTO_TEST_SUITE( pcfg_parser_test )
-
-BOOST_AUTO_TEST_CASE( test_pcfg_parser )
+// the grammar, and a sentence of lexicon scores read from etc/test/sample_input
+struct pcfg_parser_test_fixture
 {
-  state_list states("./share/pfp/states");
-  unary_grammar ug(states, "./share/pfp/unary_rules");
-  binary_grammar bg(states, "./share/pfp/binary_rules");
-  pcfg_parser pcfg(states, ug, bg);
+  state_list states;
+  unary_grammar ug;
+  binary_grammar bg;
+  pcfg_parser pcfg;
   std::vector< std::vector< state_score_t > > sentence;
 
+  pcfg_parser_test_fixture()
+  : states("./share/pfp/states"), ug(states, "./share/pfp/unary_rules"), bg(states, "./share/pfp/binary_rules"),
+    pcfg(states, ug, bg)
   {
     std::ifstream in("./etc/test/sample_input");
     std::string line;
@@ -42,7 +44,12 @@ BOOST_AUTO_TEST_CASE( test_pcfg_parser )
       sentence.push_back(word);
     }
   }
+};
 
+BOOST_AUTO_TEST_SUITE( pcfg_parser_test )
+
+BOOST_FIXTURE_TEST_CASE( test_pcfg_parser, pcfg_parser_test_fixture )
+{
   node result;
   workspace ws(sentence.size(), states.size());
   BOOST_REQUIRE_EQUAL( pcfg.parse(sentence, ws, result), true );
@@ -52,4 +59,126 @@ BOOST_AUTO_TEST_CASE( test_pcfg_parser )
   BOOST_CHECK_EQUAL( states[result.children[0]->state].tag, "S^ROOT-v" );
 }
 
+BOOST_FIXTURE_TEST_CASE( test_pcfg_parser_deadline, pcfg_parser_test_fixture )
+{
+  node result;
+  workspace ws(sentence.size(), states.size());
+  boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+  BOOST_CHECK_THROW( pcfg.parse(sentence, ws, result, now - boost::posix_time::seconds(1)), parse_timeout );
+  // the workspace is still good for the next parse
+  BOOST_REQUIRE_EQUAL( pcfg.parse(sentence, ws, result, now + boost::posix_time::hours(1)), true );
+  BOOST_CHECK_EQUAL( result.state, consts::goal_state );
+}
+
+BOOST_FIXTURE_TEST_CASE( test_pcfg_parser_stats, pcfg_parser_test_fixture )
+{
+  node plain, counted;
+  workspace ws(sentence.size(), states.size());
+  parse_stats stats;
+  BOOST_REQUIRE_EQUAL( pcfg.parse(sentence, ws, plain), true );
+  BOOST_REQUIRE_EQUAL( pcfg.parse(sentence, ws, counted, boost::posix_time::ptime(boost::posix_time::pos_infin), stats), true );
+  // counting doesn't change the parse
+  std::ostringstream plain_oss, counted_oss;
+  std::vector< std::string > words(sentence.size(), "w");
+  stitch(plain_oss, plain, words.begin(), states);
+  stitch(counted_oss, counted, words.begin(), states);
+  BOOST_CHECK_EQUAL( plain_oss.str(), counted_oss.str() );
+  // one cell per span shorter than the sentence (the boundary rules fill the last)
+  BOOST_CHECK_EQUAL( stats.cells, (sentence.size() - 1) * sentence.size() / 2 );
+  BOOST_CHECK_LE( stats.binary_pruned, stats.binary_rules );
+  BOOST_CHECK_GT( stats.puts_new, 0 );
+  BOOST_CHECK_GT( stats.unaries, 0 );
+  BOOST_CHECK_GT( stats.backtrace_steps, 0 );
+}
+
+BOOST_FIXTURE_TEST_CASE( test_pcfg_parser_sparse, pcfg_parser_test_fixture )
+{
+  node dense, first, sparse;
+  workspace ws(sentence.size(), states.size());
+  // bigger than it needs to be, and used twice, to check it clears what it used
+  sparse_workspace pws(sentence.size() + 3, states.size());
+  BOOST_REQUIRE_EQUAL( pcfg.parse(sentence, ws, dense), true );
+  BOOST_REQUIRE_EQUAL( pcfg.parse(sentence, pws, first), true );
+  BOOST_REQUIRE_EQUAL( pcfg.parse(sentence, pws, sparse), true );
+  // same chart, so the same parse with the same score
+  std::ostringstream dense_oss, sparse_oss;
+  std::vector< std::string > words(sentence.size(), "w");
+  stitch(dense_oss, dense, words.begin(), states);
+  stitch(sparse_oss, sparse, words.begin(), states);
+  BOOST_CHECK_EQUAL( dense_oss.str(), sparse_oss.str() );
+  BOOST_CHECK_EQUAL( dense.score, sparse.score );
+  for (pos_t end = 1; end != sentence.size() + 1; ++end)
+    for (pos_t begin = 0; begin != end; ++begin)
+      for (state_t state = 0; state != states.size(); ++state)
+        BOOST_REQUIRE_EQUAL( ws.get(begin, end, state), pws.get(begin, end, state) );
+  // in a fraction of the memory
+  BOOST_CHECK_LT( pws.bytes() * 2, sentence.size() * (sentence.size() + 1) / 2 * states.size() * sizeof(score_t) );
+}
+
+BOOST_FIXTURE_TEST_CASE( test_pcfg_parser_fragments, pcfg_parser_test_fixture )
+{
+  workspace ws(sentence.size(), states.size());
+  std::vector< std::string > words(sentence.size() - 1, "w");
+
+  // out of time before any rules ran: every word is a fragment of its own
+  {
+    node result;
+    BOOST_CHECK_THROW( pcfg.fill(sentence, ws, boost::posix_time::microsec_clock::universal_time() - boost::posix_time::seconds(1)),
+                       parse_timeout );
+    pcfg.fragments(sentence, ws, result);
+    BOOST_REQUIRE_EQUAL( result.state, consts::goal_state );
+    BOOST_REQUIRE_EQUAL( result.children.size(), 2 );
+    BOOST_CHECK_EQUAL( states[result.children[0]->state].tag, "FRAG" );
+    BOOST_CHECK_EQUAL( result.children[0]->children.size(), words.size() );
+    BOOST_CHECK_EQUAL( result.children[1]->state, consts::boundary_state );
+    std::ostringstream oss;
+    BOOST_CHECK( stitch(oss, result, words.begin(), states) == words.end() );
+  }
+
+  // a full chart: one constituent covers it all
+  {
+    node result;
+    BOOST_REQUIRE_EQUAL( pcfg.fill(sentence, ws), true );
+    pcfg.fragments(sentence, ws, result);
+    BOOST_REQUIRE_EQUAL( result.children.size(), 2 );
+    BOOST_REQUIRE_EQUAL( result.children[0]->children.size(), 1 );
+    BOOST_CHECK( !states[result.children[0]->children[0]->state].synthetic );
+    std::ostringstream oss;
+    BOOST_CHECK( stitch(oss, result, words.begin(), states) == words.end() );
+  }
+}
+
+BOOST_FIXTURE_TEST_CASE( test_pcfg_parser_spans, pcfg_parser_test_fixture )
+{
+  std::vector< std::string > categories;
+  categories.push_back("NP");
+  categories.push_back("VP");
+  std::vector< bool > wanted;
+  states.select(categories, wanted);
+  for (state_t s = 0; s != states.size(); ++s)
+  {
+    if (wanted[s])
+      BOOST_CHECK( states.basic_category(s) == "NP" || states.basic_category(s).compare(0, 3, "VP-") == 0
+                   || states.basic_category(s).compare(0, 3, "NP-") == 0 || states.basic_category(s) == "VP" );
+  }
+
+  // the spans straight from the chart are the ones in the tree backtrace reads out of it
+  node result;
+  std::vector< span > spans, from_tree;
+  workspace ws(sentence.size(), states.size());
+  BOOST_REQUIRE_EQUAL( pcfg.fill(sentence, ws), true );
+  pcfg.spans(sentence, ws, wanted, spans);
+  pcfg.backtrace(sentence, ws, result);
+  BOOST_CHECK_EQUAL( tree_spans(result, wanted, from_tree), sentence.size() - 1 );
+  BOOST_REQUIRE( !spans.empty() );
+  BOOST_REQUIRE_EQUAL( spans.size(), from_tree.size() );
+  for (size_t i = 0; i != spans.size(); ++i)
+  {
+    BOOST_CHECK_EQUAL( spans[i].state, from_tree[i].state );
+    BOOST_CHECK_EQUAL( spans[i].begin, from_tree[i].begin );
+    BOOST_CHECK_EQUAL( spans[i].end, from_tree[i].end );
+    BOOST_CHECK( spans[i].begin < spans[i].end && spans[i].end < sentence.size() );
+  }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
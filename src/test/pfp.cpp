@@ -16,21 +16,31 @@
 #include <pfp/lexicon.hpp>
 #include <pfp/unary_grammar.hpp>
 #include <pfp/binary_grammar.hpp>
-#include <pfp/binary_grammar.hpp>
 #include <pfp/pcfg_parser.hpp>
+#include <pfp/sentence_splitter.hpp>
+#include <pfp/tagger.hpp>
+#include <pfp/tree_writer.hpp>
+#include <pfpc/sentence_parser.hpp>
 
 using namespace com::wavii::pfp;
 using namespace boost;
 namespace fs = boost::filesystem;
 
-template<class T>
-void load(T & obj, boost::filesystem::path p)
+// the whole model, loaded the way pfpc loads it
+struct pfp_test_fixture
 {
-  if (!fs::exists(p))
-    throw std::runtime_error("can't find " + p.string());
-  std::ifstream in(p.string().c_str());
-  obj.load(in);
-}
+  tokenizer tok;
+  state_list states;
+  lexicon lex;
+  unary_grammar ug;
+  binary_grammar bg;
+  pcfg_parser pcfg;
+
+  pfp_test_fixture() : lex(states), ug(states), bg(states), pcfg(states, ug, bg)
+  {
+    load_model("./share/pfp", tok, states, lex, ug, bg);
+  }
+};
 
 BOOST_AUTO_TEST_SUITE( pfp_parser_test )
 
@@ -92,4 +102,180 @@ BOOST_AUTO_TEST_CASE( test_pfp_hash )
    }
 }
 
+// read back a varint written by binary_writer
+static boost::uint64_t read_varint(const std::string & in, size_t & at)
+{
+  boost::uint64_t n = 0;
+  for (int shift = 0; ; shift += 7)
+  {
+    unsigned char c = static_cast< unsigned char >(in.at(at++));
+    n |= static_cast< boost::uint64_t >(c & 0x7f) << shift;
+    if (!(c & 0x80))
+      return n;
+  }
+}
+
+// turn a binary_writer node back into brackets, as a client would decode it
+static void read_binary(const std::string & in, size_t & at, const std::vector< std::string > & labels, std::string & out)
+{
+  out += '(' + labels.at(read_varint(in, at)) + ' ';
+  read_varint(in, at); // the score
+  size_t children = read_varint(in, at);
+  if (children == 0)
+  {
+    size_t length = read_varint(in, at);
+    out += in.substr(at, length);
+    at += length;
+  }
+  for (size_t i = 0; i != children; ++i)
+  {
+    read_binary(in, at, labels, out);
+    if (i + 1 != children)
+      out += ' ';
+  }
+  out += ')';
+}
+
+BOOST_FIXTURE_TEST_CASE( test_pfp_writers, pfp_test_fixture )
+{
+  workspace w(45, states.size());
+
+  std::vector< std::string > words;
+  std::vector< std::vector< state_score_t > > sentence_f;
+  node result;
+  tok.tokenize("I love \"monkeys\".", words);
+  for (std::vector< std::string >::const_iterator it = words.begin(); it != words.end(); ++it)
+  {
+    sentence_f.push_back(std::vector< state_score_t >());
+    lex.chart_score(*it, std::back_inserter(sentence_f.back()));
+  }
+  sentence_f.push_back( std::vector< state_score_t >(1, state_score_t(consts::boundary_state, 0.0f)));
+  BOOST_REQUIRE( pcfg.parse(sentence_f, w, result) );
+  std::ostringstream oss;
+  stitch(oss, result, words.begin(), states);
+
+  // brackets just as stitch writes them, appended to what's already in the buffer
+  std::string out = "junk";
+  bracket_writer()(out, result, words, states);
+  BOOST_CHECK_EQUAL( out, "junk" + oss.str() );
+
+  // json with spans, scores, and escaped words
+  out.clear();
+  write_tree(json_format, out, result, words, states);
+  const std::string root = "{\"label\":\"ROOT\",\"begin\":0,\"score\":";
+  BOOST_CHECK_EQUAL( out.compare(0, root.size(), root), 0 );
+  std::ostringstream end;
+  end << ",\"end\":" << words.size() << "}";
+  BOOST_CHECK_EQUAL( out.compare(out.size() - end.str().size(), end.str().size(), end.str()), 0 );
+  BOOST_CHECK( out.find("{\"label\":\"PRP\",\"begin\":0,\"score\":") != std::string::npos );
+  BOOST_CHECK( out.find("\"word\":\"I\",\"end\":1}") != std::string::npos );
+  BOOST_CHECK( out.find("\"word\":\"monkeys\",\"end\":4}") != std::string::npos );
+  BOOST_CHECK_EQUAL( std::count(out.begin(), out.end(), '{'), std::count(out.begin(), out.end(), '}') );
+  std::string quoted;
+  json_writer::quote(quoted, "a\"b\\c\n");
+  BOOST_CHECK_EQUAL( quoted, "\"a\\\"b\\\\c\\u000a\"" );
+
+  // binary decodes back into the same tree
+  out.clear();
+  write_tree(binary_format, out, result, words, states);
+  size_t at = 0;
+  std::vector< std::string > labels(read_varint(out, at));
+  for (std::vector< std::string >::iterator it = labels.begin(); it != labels.end(); ++it)
+  {
+    size_t length = read_varint(out, at);
+    *it = out.substr(at, length);
+    at += length;
+  }
+  BOOST_CHECK_EQUAL( labels[0], "ROOT" );
+  std::string decoded;
+  read_binary(out, at, labels, decoded);
+  BOOST_CHECK_EQUAL( at, out.size() );
+  // stitch leaves a space where the boundary was
+  std::string expected = oss.str();
+  expected.erase(expected.size() - 2, 1);
+  BOOST_CHECK_EQUAL( decoded, expected );
+}
+
+BOOST_FIXTURE_TEST_CASE( test_pfp_split, pfp_test_fixture )
+{
+  workspace w(45, states.size());
+  sentence_splitter splitter(states, 20);
+
+  const std::string sentence = "The committee met on Tuesday to review the budget for next year ; "
+                               "the members argued for hours about the new library , "
+                               "but they could not agree on the plan .";
+  std::vector< std::string > words;
+  tok.tokenize(sentence, words);
+
+  // cut after the semicolon, and at the comma before but
+  std::vector< size_t > ends;
+  BOOST_REQUIRE( splitter.split(words, ends) );
+  BOOST_REQUIRE_EQUAL( ends.size(), 3 );
+  BOOST_CHECK_EQUAL( words[ends[0] - 1], ";" );
+  BOOST_CHECK_EQUAL( words[ends[1] - 1], "," );
+  BOOST_CHECK_EQUAL( ends[2], words.size() );
+
+  // short sentences, and those with nowhere safe to cut, stay whole
+  std::vector< std::string > short_words(words.begin(), words.begin() + ends[0]);
+  BOOST_CHECK( !splitter.split(short_words, ends) );
+  BOOST_CHECK_EQUAL( ends.size(), 1 );
+  std::vector< std::string > uncut(30, "monkeys");
+  BOOST_CHECK( !sentence_splitter(states, 20).split(uncut, ends) );
+
+  // each piece parses on its own, and the pieces join into a single tree over every word
+  splitter.split(words, ends);
+  std::vector< node > segments(ends.size());
+  for (size_t i = 0, begin = 0; i != ends.size(); begin = ends[i++])
+  {
+    std::vector< std::vector< state_score_t > > sentence_f;
+    for (size_t j = begin; j != ends[i]; ++j)
+    {
+      sentence_f.push_back(std::vector< state_score_t >());
+      lex.chart_score(words[j], std::back_inserter(sentence_f.back()));
+    }
+    sentence_f.push_back( std::vector< state_score_t >(1, state_score_t(consts::boundary_state, 0.0f)));
+    if (!pcfg.parse(sentence_f, w, segments[i]))
+      BOOST_FAIL("Parsing a segment shouldn't fail!");
+  }
+  node result;
+  splitter.join(segments, result);
+  BOOST_REQUIRE_EQUAL( result.state, consts::goal_state );
+  BOOST_REQUIRE_EQUAL( result.children.size(), 2 );
+  BOOST_CHECK_EQUAL( result.children[1]->state, consts::boundary_state );
+  BOOST_CHECK_EQUAL( states[result.children[0]->state].tag, "S^ROOT-v" );
+  BOOST_CHECK_EQUAL( result.children[0]->children.size(), ends.size() );
+
+  std::ostringstream oss;
+  std::vector< std::string >::iterator word_it = words.begin();
+  word_it = stitch(oss, result, word_it, states);
+  BOOST_CHECK( word_it == words.end() );
+  BOOST_CHECK_EQUAL( oss.str().compare(0, 9, "(ROOT (S "), 0 );
+}
+
+BOOST_FIXTURE_TEST_CASE( test_pfp_tag, pfp_test_fixture )
+{
+  tagger tagger(states, lex, ug, bg);
+  tagger.init();
+
+  std::vector< std::string > words;
+  std::vector< state_t > tags;
+  tagger.tag(words, tags);
+  BOOST_CHECK( tags.empty() );
+
+  // the same tags the parser gives these words
+  tok.tokenize("I love monkeys.", words);
+  tagger.tag(words, tags);
+  BOOST_REQUIRE_EQUAL( tags.size(), words.size() );
+  std::ostringstream oss;
+  stitch_tags(oss, words.begin(), words.end(), tags, states);
+  BOOST_CHECK_EQUAL( oss.str(), "I/PRP love/VBP monkeys/NNS ./." );
+
+  oss.str("");
+  words.clear();
+  tok.tokenize("The board approved the merger after a long debate .", words);
+  tagger.tag(words, tags);
+  stitch_tags(oss, words.begin(), words.end(), tags, states);
+  BOOST_CHECK_EQUAL( oss.str(), "The/DT board/NN approved/VBD the/DT merger/NN after/IN a/DT long/JJ debate/NN ./." );
+}
+
 BOOST_AUTO_TEST_SUITE_END()
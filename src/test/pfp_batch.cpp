@@ -0,0 +1,144 @@
+#include <cstdio>
+#include <string>
+#include <fstream>
+#include <stdexcept>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/test/test_tools.hpp>
+
+#include <boost/cstdint.hpp>
+
+#include <pfpc/batch_index.hpp>
+#include <pfpc/chunk_deques.hpp>
+
+using namespace com::wavii::pfp;
+
+// writes an index for a test to read back, and removes it once the test's done
+struct batch_index_test_fixture
+{
+  std::string       path;
+  boost::uintmax_t  input_end, output_end, sentences, index_end;
+
+  batch_index_test_fixture() : path("pfp_batch_test.idx"), input_end(7), output_end(7), sentences(7), index_end(7) {}
+
+  ~batch_index_test_fixture() { std::remove(path.c_str()); }
+
+  void write(const std::string & contents)
+  {
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    out << contents;
+  }
+
+  void read(boost::uintmax_t input_size = 1000, const std::string & format = "brackets")
+  {
+    read_checkpoint(path, input_size, format, input_end, output_end, sentences, index_end);
+  }
+};
+
+static const std::string header = "pfp_batch 1000 brackets\n";
+
+BOOST_AUTO_TEST_SUITE( pfp_batch_test )
+
+BOOST_FIXTURE_TEST_CASE( test_read_checkpoint, batch_index_test_fixture )
+{
+  write(header + "100 400 10\n250 900 21\n");
+  read();
+  BOOST_CHECK_EQUAL( input_end, 250 );
+  BOOST_CHECK_EQUAL( output_end, 900 );
+  BOOST_CHECK_EQUAL( sentences, 21 );
+  BOOST_CHECK_EQUAL( index_end, header.size() + 22 );
+}
+
+BOOST_FIXTURE_TEST_CASE( test_read_checkpoint_header_only, batch_index_test_fixture )
+{
+  // nothing written yet: start at the beginning
+  write(header);
+  read();
+  BOOST_CHECK_EQUAL( input_end, 0 );
+  BOOST_CHECK_EQUAL( output_end, 0 );
+  BOOST_CHECK_EQUAL( sentences, 0 );
+  BOOST_CHECK_EQUAL( index_end, header.size() );
+}
+
+BOOST_FIXTURE_TEST_CASE( test_read_checkpoint_partial_line, batch_index_test_fixture )
+{
+  // the last run died writing a line, which doesn't count, and is cut off
+  write(header + "100 400 10\n250 9");
+  read();
+  BOOST_CHECK_EQUAL( input_end, 100 );
+  BOOST_CHECK_EQUAL( output_end, 400 );
+  BOOST_CHECK_EQUAL( sentences, 10 );
+  BOOST_CHECK_EQUAL( index_end, header.size() + 11 );
+}
+
+BOOST_FIXTURE_TEST_CASE( test_read_checkpoint_truncated, batch_index_test_fixture )
+{
+  write("");
+  BOOST_CHECK_THROW( read(), std::runtime_error );
+  // a header without its newline might be missing its end
+  write("pfp_batch 1000 brack");
+  BOOST_CHECK_THROW( read(), std::runtime_error );
+  write("pfp_batch 1000\n");
+  BOOST_CHECK_THROW( read(), std::runtime_error );
+  // and an entry that isn't three numbers is corrupt, not partial
+  write(header + "100 400\n");
+  BOOST_CHECK_THROW( read(), std::runtime_error );
+}
+
+BOOST_FIXTURE_TEST_CASE( test_read_checkpoint_mismatch, batch_index_test_fixture )
+{
+  write(header + "100 400 10\n");
+  // an index of another input
+  BOOST_CHECK_THROW( read(999), std::runtime_error );
+  // or parses in another format
+  BOOST_CHECK_THROW( read(1000, "json"), std::runtime_error );
+  // or something else entirely
+  write("pfp_batches 1000 brackets\n");
+  BOOST_CHECK_THROW( read(), std::runtime_error );
+}
+
+BOOST_AUTO_TEST_CASE( test_chunk_deques_take )
+{
+  chunk_deques chunks(3, 0, 8);
+  size_t chunk;
+  // each worker takes its own chunks first, dealt round robin
+  BOOST_REQUIRE( chunks.take(0, chunk) );
+  BOOST_CHECK_EQUAL( chunk, 0 );
+  BOOST_REQUIRE( chunks.take(0, chunk) );
+  BOOST_CHECK_EQUAL( chunk, 3 );
+  BOOST_REQUIRE( chunks.take(0, chunk) );
+  BOOST_CHECK_EQUAL( chunk, 6 );
+  BOOST_REQUIRE( chunks.take(1, chunk) );
+  BOOST_CHECK_EQUAL( chunk, 1 );
+  // worker 0's run dry, so it steals the earliest chunk left, from the front of worker 2's deque
+  BOOST_REQUIRE( chunks.take(0, chunk) );
+  BOOST_CHECK_EQUAL( chunk, 2 );
+  BOOST_REQUIRE( chunks.take(0, chunk) );
+  BOOST_CHECK_EQUAL( chunk, 4 );
+  // worker 2 still has its own
+  BOOST_REQUIRE( chunks.take(2, chunk) );
+  BOOST_CHECK_EQUAL( chunk, 5 );
+  BOOST_REQUIRE( chunks.take(2, chunk) );
+  BOOST_CHECK_EQUAL( chunk, 7 );
+  BOOST_CHECK( !chunks.take(2, chunk) );
+  BOOST_CHECK( !chunks.take(1, chunk) );
+}
+
+BOOST_AUTO_TEST_CASE( test_chunk_deques_resume )
+{
+  // chunks left after a checkpoint are dealt from the first of them
+  chunk_deques chunks(2, 5, 8);
+  size_t chunk;
+  BOOST_REQUIRE( chunks.take(1, chunk) );
+  BOOST_CHECK_EQUAL( chunk, 6 );
+  BOOST_REQUIRE( chunks.take(1, chunk) );
+  BOOST_CHECK_EQUAL( chunk, 5 );
+  BOOST_REQUIRE( chunks.take(1, chunk) );
+  BOOST_CHECK_EQUAL( chunk, 7 );
+  BOOST_CHECK( !chunks.take(0, chunk) );
+  // and with none at all, there's nothing to take
+  chunk_deques none(2, 3, 3);
+  BOOST_CHECK( !none.take(0, chunk) );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,48 @@
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/test/test_tools.hpp>
+
+#include <pfpd/pfpd_handler.h>
+
+using namespace com::wavii::pfp;
+
+// a handler loaded from ./share/pfp, with one workspace of each class and no cache
+struct pfpd_handler_test_fixture
+{
+  pfpd_handler handler;
+
+  pfpd_handler_test_fixture()
+  {
+    handler.init(45, 1, "./share/pfp", 8, 0);
+  }
+
+  std::string post(const std::string & uri, const std::string & content)
+  {
+    moost::http::request req;
+    req.method = "POST";
+    req.uri = uri;
+    req.http_version_major = req.http_version_minor = 1;
+    req.content = content;
+    moost::http::reply rep;
+    handler.handle_request(req, rep);
+    return rep.content;
+  }
+};
+
+BOOST_AUTO_TEST_SUITE( pfpd_handler_test )
+
+BOOST_FIXTURE_TEST_CASE( test_pfpd_handler_tag_lines, pfpd_handler_test_fixture )
+{
+  // each line of tokens is tagged on its own, whatever came before it, malformed or not
+  std::string tags = post("/tag", "[\"I\",\"love\",\"monkeys\",\".\"]\n"
+                                  "[\"monkeys\",\"love\"\n"
+                                  "[\"They\",\"love\",\"me\",\".\"]\n"
+                                  "I love monkeys.\n");
+  BOOST_CHECK_EQUAL( tags, "I/PRP love/VBP monkeys/NNS ./.\n"
+                           "\n"
+                           "They/PRP love/VBP me/PRP ./.\n"
+                           "I/PRP love/VBP monkeys/NNS ./.\n" );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,156 @@
+#include <string>
+#include <stdexcept>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/test/test_tools.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include <pfpd/single_flight.hpp>
+
+#include "latch.hpp"
+
+using namespace com::wavii::pfp;
+
+// a call that answers value, once gate (if any) opens, saying whether others may share it
+static bool answer(const std::string & value, bool ok, latch * gate, std::string & out)
+{
+  if (gate)
+    gate->wait();
+  out = value;
+  return ok;
+}
+
+// a call that fails, once gate opens
+static bool fail(latch * gate, std::string &)
+{
+  gate->wait();
+  throw std::runtime_error("out of memory");
+}
+
+// one request: run a call on a key through flight, and keep what came of it
+struct request
+{
+  single_flight &                         flight;
+  boost::function< bool (std::string &) > fn;
+  boost::posix_time::ptime                deadline;
+  std::string                             result;
+  bool                                    shared;
+  bool                                    answered;
+  bool                                    threw;
+
+  request(single_flight & flight, const std::string & value, bool ok, latch * gate = 0,
+          boost::posix_time::ptime deadline = boost::posix_time::ptime(boost::posix_time::pos_infin))
+  : flight(flight), fn(boost::bind(answer, value, ok, gate, _1)), deadline(deadline), shared(false), answered(false), threw(false) {}
+
+  void operator()()
+  {
+    try { answered = flight.run("I love monkeys .", fn, deadline, result, shared); }
+    catch (const std::runtime_error &) { threw = true; }
+  }
+};
+
+// wait until flight has a call running
+static void wait_for_call(single_flight & flight)
+{
+  while (flight.size() == 0)
+    boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+}
+
+BOOST_AUTO_TEST_SUITE( single_flight_test )
+
+BOOST_AUTO_TEST_CASE( test_single_flight_partial )
+{
+  single_flight flight;
+  latch gate;
+  // the leader's deadline is short, so it settles for fragments, which are only good enough for it
+  request leader(flight, "fragments", false, &gate, boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(10));
+  request waiter(flight, "parse", true);
+  boost::thread leading(boost::ref(leader));
+  wait_for_call(flight);
+  // the waiter, with no deadline at all, joins the leader's call
+  boost::thread waiting(boost::ref(waiter));
+  boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+  gate.release();
+  leading.join();
+  waiting.join();
+  BOOST_CHECK( leader.answered );
+  BOOST_CHECK_EQUAL( leader.result, "fragments" );
+  // rather than take the fragments, the waiter parsed for itself
+  BOOST_CHECK( waiter.answered );
+  BOOST_CHECK_EQUAL( waiter.result, "parse" );
+  BOOST_CHECK( !waiter.shared );
+  BOOST_CHECK_EQUAL( flight.size(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( test_single_flight_shared )
+{
+  single_flight flight;
+  latch gate;
+  request leader(flight, "parse", true, &gate), waiter(flight, "another parse", true);
+  boost::thread leading(boost::ref(leader));
+  wait_for_call(flight);
+  boost::thread waiting(boost::ref(waiter));
+  boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+  gate.release();
+  leading.join();
+  waiting.join();
+  BOOST_CHECK( leader.answered && !leader.shared );
+  // the waiter got the leader's answer, and never ran its own call
+  BOOST_CHECK( waiter.answered && waiter.shared );
+  BOOST_CHECK_EQUAL( waiter.result, "parse" );
+  BOOST_CHECK_EQUAL( flight.size(), 0 );
+
+  // once the call's done, the next request runs its own
+  request later(flight, "a later parse", true);
+  later();
+  BOOST_CHECK( later.answered && !later.shared );
+  BOOST_CHECK_EQUAL( later.result, "a later parse" );
+}
+
+BOOST_AUTO_TEST_CASE( test_single_flight_deadline )
+{
+  single_flight flight;
+  latch gate;
+  request leader(flight, "parse", true, &gate);
+  request waiter(flight, "another parse", true, 0,
+                 boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(20));
+  boost::thread leading(boost::ref(leader));
+  wait_for_call(flight);
+  // the waiter gives up when its deadline passes, without a result
+  waiter();
+  BOOST_CHECK( !waiter.answered );
+  BOOST_CHECK( waiter.result.empty() );
+  // and the leader carries on
+  BOOST_CHECK_EQUAL( flight.size(), 1 );
+  gate.release();
+  leading.join();
+  BOOST_CHECK( leader.answered );
+  BOOST_CHECK_EQUAL( flight.size(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( test_single_flight_throws )
+{
+  single_flight flight;
+  latch gate;
+  request leader(flight, "parse", true), waiter(flight, "another parse", true);
+  leader.fn = boost::bind(fail, &gate, _1);
+  boost::thread leading(boost::ref(leader));
+  wait_for_call(flight);
+  boost::thread waiting(boost::ref(waiter));
+  boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+  gate.release();
+  leading.join();
+  waiting.join();
+  // the leader's exception is its own: the waiter takes over, and runs its call
+  BOOST_CHECK( leader.threw );
+  BOOST_CHECK( !waiter.threw );
+  BOOST_CHECK( waiter.answered && !waiter.shared );
+  BOOST_CHECK_EQUAL( waiter.result, "another parse" );
+  BOOST_CHECK_EQUAL( flight.size(), 0 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,50 @@
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/test/test_tools.hpp>
+
+#include <pfp/state_list.hpp>
+
+using namespace com::wavii::pfp;
+
+BOOST_AUTO_TEST_SUITE( state_list_test )
+
+BOOST_AUTO_TEST_CASE( test_state_list_categories )
+{
+  state_list states("./share/pfp/states");
+  BOOST_REQUIRE( states.categories() > 0 );
+  BOOST_CHECK( states.categories() < states.size() );
+  for (state_t s = 0; s != states.size(); ++s)
+  {
+    // the tag up to the first delimiter, and the same category for the same name
+    const std::string & tag = states[s].tag, & category = states.basic_category(s);
+    BOOST_REQUIRE_EQUAL( tag.compare(0, category.size(), category), 0 );
+    BOOST_CHECK( category.size() == tag.size() || std::string("=|#^~_").find(tag[category.size()]) != std::string::npos );
+    category_t c;
+    BOOST_REQUIRE( states.find_category(category, c) );
+    BOOST_CHECK_EQUAL( c, states.category(s) );
+    BOOST_CHECK_EQUAL( &states.category_name(c), &category );
+  }
+  category_t c = 0;
+  BOOST_REQUIRE( states.find_category("NP", c) );
+  BOOST_CHECK_EQUAL( states.category_name(c), "NP" );
+  BOOST_CHECK( !states.find_category("NOT-A-CATEGORY", c) );
+}
+
+BOOST_AUTO_TEST_CASE( test_state_list_find_state )
+{
+  state_list states("./share/pfp/states");
+  for (state_t s = 0; s != states.size(); ++s)
+  {
+    state_t found = consts::goal_state;
+    BOOST_CHECK_EQUAL( states.find_state(states[s].tag, found), !states[s].synthetic );
+    if (!states[s].synthetic)
+      BOOST_CHECK_EQUAL( states[found].tag, states[s].tag );
+  }
+  state_t frag = consts::goal_state;
+  BOOST_REQUIRE( states.find_state("FRAG", frag) );
+  BOOST_CHECK_EQUAL( states[frag].tag, "FRAG" );
+  BOOST_CHECK( !states.find_state("NOT-A-STATE", frag) );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
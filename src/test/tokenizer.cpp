@@ -7,6 +7,7 @@
 #include <boost/test/test_tools.hpp>
 
 #include <pfp/tokenizer.h>
+#include <pfp/document_tokenizer.hpp>
 
 using namespace com::wavii::pfp;
 
@@ -83,6 +84,18 @@ BOOST_FIXTURE_TEST_CASE( test_americanize, tokenizer_test_fixture )
   BOOST_REQUIRE_EQUAL(words[4], "superleukemia");
 }
 
+BOOST_FIXTURE_TEST_CASE( test_americanize_rules, tokenizer_test_fixture )
+{
+  t.tokenize("programmes anaemia glamour armours Colour haemhaemo", words);
+  BOOST_REQUIRE_EQUAL(words.size(), 6);
+  BOOST_REQUIRE_EQUAL(words[0], "programs");
+  BOOST_REQUIRE_EQUAL(words[1], "anemia");
+  BOOST_REQUIRE_EQUAL(words[2], "glamour");
+  BOOST_REQUIRE_EQUAL(words[3], "armors");
+  BOOST_REQUIRE_EQUAL(words[4], "Colour");
+  BOOST_REQUIRE_EQUAL(words[5], "haemhemo");
+}
+
 BOOST_FIXTURE_TEST_CASE( test_escape, tokenizer_test_fixture )
 {
   t.tokenize("this / that", words);
@@ -93,6 +106,82 @@ BOOST_FIXTURE_TEST_CASE( test_escape, tokenizer_test_fixture )
   BOOST_REQUIRE_EQUAL(words[1], "\\/");
 }
 
+BOOST_FIXTURE_TEST_CASE( test_cp1252, tokenizer_test_fixture )
+{
+  t.tokenize("\xe2\x80\x9cyes\xe2\x80\x9d", words);
+  BOOST_REQUIRE_EQUAL(words.size(), 3);
+  BOOST_REQUIRE_EQUAL(words[0], "``");
+  BOOST_REQUIRE_EQUAL(words[2], "''");
+  words.clear(); t.tokenize("\xc2\xa2 \xc2\xa3 \xe2\x82\xac \xc2\xbd", words);
+  BOOST_REQUIRE_EQUAL(words.size(), 4);
+  BOOST_REQUIRE_EQUAL(words[0], "cents");
+  BOOST_REQUIRE_EQUAL(words[1], "#");
+  BOOST_REQUIRE_EQUAL(words[2], "$");
+  BOOST_REQUIRE_EQUAL(words[3], "1\\/2");
+}
+
+BOOST_FIXTURE_TEST_CASE( test_spans, tokenizer_test_fixture )
+{
+  const std::string in = "the colour (of) dang'it \xe2\x80\x9cmonkeys\xe2\x80\x9d";
+  std::vector<tokenizer::span> spans;
+  std::string arena;
+  t.tokenize(in, words);
+  t.tokenize(in, spans, arena);
+  BOOST_REQUIRE_EQUAL(spans.size(), words.size());
+  for (size_t i = 0; i != spans.size(); ++i)
+    BOOST_CHECK_EQUAL(spans[i].str(in, arena), words[i]);
+  // untouched words point straight into the input
+  BOOST_CHECK_EQUAL(spans[0].normalized, false);
+  BOOST_CHECK_EQUAL(spans[0].begin, 0);
+  BOOST_CHECK_EQUAL(spans[0].size, 3);
+  // rewritten words keep their source extent
+  BOOST_CHECK_EQUAL(spans[1].normalized, true);
+  BOOST_CHECK_EQUAL(in.substr(spans[1].begin, spans[1].size), "colour");
+  BOOST_CHECK_EQUAL(in.substr(spans[2].begin, spans[2].size), "(");
+  BOOST_CHECK_EQUAL(words[6], "`");
+  BOOST_CHECK_EQUAL(spans[6].begin, in.find('\''));
+  BOOST_CHECK_EQUAL(spans[6].size, 1);
+  BOOST_CHECK_EQUAL(in.substr(spans[8].begin, spans[8].size), "\xe2\x80\x9c");
+}
+
+BOOST_FIXTURE_TEST_CASE( test_document, tokenizer_test_fixture )
+{
+  std::istringstream in("Hello there. How are you?! I said \"fine.\" Then\nwe left\n\nA new paragraph");
+  // a tiny block size forces sentences to straddle blocks
+  document_tokenizer doc(t, in, 16);
+  BOOST_REQUIRE(doc.next(words));
+  BOOST_REQUIRE_EQUAL(words.size(), 3);
+  BOOST_CHECK_EQUAL(doc.begin_offset(), 0);
+  BOOST_CHECK_EQUAL(doc.end_offset(), 12);
+  BOOST_REQUIRE(doc.next(words));
+  BOOST_REQUIRE_EQUAL(words.size(), 5);
+  BOOST_CHECK_EQUAL(words[4], "!");
+  BOOST_REQUIRE(doc.next(words));
+  BOOST_REQUIRE_EQUAL(words.size(), 6);
+  BOOST_CHECK_EQUAL(words[5], "''");
+  BOOST_REQUIRE(doc.next(words));
+  BOOST_REQUIRE_EQUAL(words.size(), 3);
+  BOOST_CHECK_EQUAL(words[2], "left");
+  BOOST_REQUIRE(doc.next(words));
+  BOOST_REQUIRE_EQUAL(words.size(), 3);
+  BOOST_CHECK_EQUAL(words[0], "A");
+  BOOST_CHECK(!doc.next(words));
+}
+
+BOOST_FIXTURE_TEST_CASE( test_document_long_word, tokenizer_test_fixture )
+{
+  // a word longer than a block, with no line break or space to cut at, stays whole
+  std::string word(40, 'a');
+  std::istringstream in("Say " + word + " now.");
+  document_tokenizer doc(t, in, 16);
+  BOOST_REQUIRE(doc.next(words));
+  BOOST_REQUIRE_EQUAL(words.size(), 4);
+  BOOST_CHECK_EQUAL(words[1], word);
+  BOOST_CHECK_EQUAL(words[2], "now");
+  BOOST_CHECK_EQUAL(doc.end_offset(), in.str().size());
+  BOOST_CHECK(!doc.next(words));
+}
+
 BOOST_FIXTURE_TEST_CASE( test_period, tokenizer_test_fixture )
 {
   t.tokenize("Bob, Inc. bought a monkey.", words);
@@ -0,0 +1,179 @@
+#include <string>
+#include <sstream>
+#include <stdexcept>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/test/test_tools.hpp>
+
+#include <boost/ref.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include <pfpd/workspace_pool.hpp>
+
+using namespace com::wavii::pfp;
+
+// few states keep the workspaces small
+static const state_t states = 4;
+
+// how many workspaces the pool reports for a class and state, such as "9" and "busy"
+static size_t count(workspace_pool & pool, const std::string & words, const std::string & state)
+{
+  std::ostringstream oss;
+  pool.write(oss);
+  std::istringstream iss(oss.str());
+  std::string name = "pfpd_workspaces{words=\"" + words + "\",state=\"" + state + "\"} ", line;
+  while (std::getline(iss, line))
+  {
+    if (line.compare(0, name.size(), name) == 0)
+      return boost::lexical_cast< size_t >(line.substr(name.size()));
+  }
+  BOOST_FAIL("no metric " + name);
+  return 0;
+}
+
+// takes a workspace for a sentence on a thread of its own, and holds it until it's let go
+template<class Scoped>
+struct taker
+{
+  workspace_pool &  pool;
+  size_t            words;
+  boost::mutex      mutex;
+  pos_t             got;   // the size of the workspace it got, or 0 while it waits
+  bool              done;
+
+  taker(workspace_pool & pool, size_t words) : pool(pool), words(words), got(0), done(false) {}
+
+  void operator()()
+  {
+    Scoped w(pool, words);
+    boost::mutex::scoped_lock lock(mutex);
+    got = w->words;
+    // hold it until we're let go
+    while (!done)
+    {
+      lock.unlock();
+      boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+      lock.lock();
+    }
+  }
+
+  pos_t wait_a_while()
+  {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+    boost::mutex::scoped_lock lock(mutex);
+    return got;
+  }
+
+  void let_go()
+  {
+    boost::mutex::scoped_lock lock(mutex);
+    done = true;
+  }
+};
+
+BOOST_AUTO_TEST_SUITE( workspace_pool_test )
+
+BOOST_AUTO_TEST_CASE( test_workspace_pool_classes )
+{
+  workspace_pool pool;
+  pool.init(9, 3, 1, states);
+  BOOST_CHECK_EQUAL( pool.longest(), 9 );
+  // a sentence takes the smallest class it fits
+  {
+    workspace_pool::scoped_workspace w(pool, 2);
+    BOOST_CHECK_EQUAL( w->words, 3 );
+  }
+  {
+    workspace_pool::scoped_workspace w(pool, 4);
+    BOOST_CHECK_EQUAL( w->words, 6 );
+  }
+  {
+    workspace_pool::scoped_workspace w(pool, 9);
+    BOOST_CHECK_EQUAL( w->words, 9 );
+  }
+  // and nothing past the largest
+  BOOST_CHECK_THROW( workspace_pool::scoped_workspace w(pool, 10), std::runtime_error );
+  // a class that's full sends it on to the next one up
+  {
+    workspace_pool::scoped_workspace small(pool, 3);
+    workspace_pool::scoped_workspace w(pool, 2);
+    BOOST_CHECK_EQUAL( small->words, 3 );
+    BOOST_CHECK_EQUAL( w->words, 6 );
+  }
+  // fewer words than classes get a class a word
+  workspace_pool few;
+  few.init(2, 3, 1, states);
+  BOOST_CHECK_EQUAL( count(few, "1", "idle"), 0 );
+  BOOST_CHECK_EQUAL( count(few, "2", "idle"), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( test_workspace_pool_growth )
+{
+  workspace_pool pool;
+  pool.init(9, 1, 2, states);
+  BOOST_CHECK_EQUAL( count(pool, "9", "busy") + count(pool, "9", "idle"), 0 );
+  {
+    workspace_pool::scoped_workspace w1(pool, 5);
+    BOOST_CHECK_EQUAL( count(pool, "9", "busy"), 1 );
+    {
+      workspace_pool::scoped_workspace w2(pool, 5);
+      BOOST_CHECK_EQUAL( count(pool, "9", "busy"), 2 );
+    }
+    BOOST_CHECK_EQUAL( count(pool, "9", "busy"), 1 );
+    BOOST_CHECK_EQUAL( count(pool, "9", "idle"), 1 );
+    // a free workspace is taken rather than allocating another
+    workspace_pool::scoped_workspace w3(pool, 5);
+    BOOST_CHECK_EQUAL( count(pool, "9", "busy"), 2 );
+    BOOST_CHECK_EQUAL( count(pool, "9", "idle"), 0 );
+  }
+  BOOST_CHECK_EQUAL( count(pool, "9", "idle"), 2 );
+}
+
+BOOST_AUTO_TEST_CASE( test_workspace_pool_full )
+{
+  workspace_pool pool;
+  pool.init(9, 3, 1, states);
+  taker< workspace_pool::scoped_workspace > waiter(pool, 2);
+  boost::thread waiting;
+  {
+    boost::scoped_ptr< workspace_pool::scoped_workspace > w3(new workspace_pool::scoped_workspace(pool, 3));
+    workspace_pool::scoped_workspace w6(pool, 6), w9(pool, 9);
+    // every class it fits is at its limit, so it waits
+    waiting = boost::thread(boost::ref(waiter));
+    BOOST_CHECK_EQUAL( waiter.wait_a_while(), 0 );
+    // until one of them is free
+    w3.reset();
+    BOOST_CHECK_EQUAL( waiter.wait_a_while(), 3 );
+  }
+  waiter.let_go();
+  waiting.join();
+  BOOST_CHECK_EQUAL( count(pool, "3", "busy"), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( test_workspace_pool_oversized )
+{
+  workspace_pool pool;
+  pool.init(9, 3, 1, states, 1);
+  taker< workspace_pool::scoped_oversized > waiter(pool, 11);
+  boost::thread waiting;
+  {
+    workspace_pool::scoped_oversized w(pool, 12);
+    BOOST_CHECK_EQUAL( w->words, 12 );
+    BOOST_CHECK_EQUAL( count(pool, "+Inf", "busy"), 1 );
+    // only one sparse workspace at a time
+    waiting = boost::thread(boost::ref(waiter));
+    BOOST_CHECK_EQUAL( waiter.wait_a_while(), 0 );
+  }
+  BOOST_CHECK_EQUAL( waiter.wait_a_while(), 11 );
+  waiter.let_go();
+  waiting.join();
+  BOOST_CHECK_EQUAL( count(pool, "+Inf", "busy"), 0 );
+  // and none past what a chart can hold at all
+  BOOST_CHECK_THROW( workspace_pool::scoped_oversized w(pool, consts::max_sentence_size + 1), std::runtime_error );
+}
+
+BOOST_AUTO_TEST_SUITE_END()